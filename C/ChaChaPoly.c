@@ -1,6 +1,10 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include "Crypto.h"
 
@@ -18,50 +22,79 @@ void PrintBinAsHex(unsigned char *input, unsigned int strLength) {
   }
 }
 
-/*  ChaCha20 encryption function
+/* ChaCha20 encryption with a precomputed key object. Works in place, the
+ * keystream is generated up to CHACHA_LANES blocks at a time.
  */
-int ErikChaCha20Encrypt(unsigned char *input, unsigned int inLen, unsigned char *key, unsigned char *nonce, uint32_t counter, unsigned char *output) {
-  unsigned int inputLen = 0, totalBlocks = 0;
-  unsigned int ind = 0, innerInd = 0;
-  unsigned char keyStream[65] = {0};
-  unsigned char *tempOutput;
+int ChaCha20KeyEncrypt(const struct chacha20Key *chachaKey, unsigned char *input, unsigned long inLen, uint32_t counter, unsigned char *output) {
+  unsigned long ind = 0, innerInd = 0, numBytes = 0;
+  unsigned int numBlocks = 0;
+  unsigned char keyStream[CHACHA_LANES*CHACHA_BLOCK_SIZE_BYTES];
 
-  if (!(input) || !(key) || !(nonce) || !(output)) {
+  if (!(chachaKey) || (!(input) && inLen) || (!(output) && inLen)) {
     fprintf(stderr, "ERROR - CHACHA20: invalid input to top level function.\n");
     return ERR_CHACHA_MAIN;
   }
-  
-  inputLen = inLen;
-  totalBlocks = (inputLen / 64) + (!(inputLen % 64) ? 0 : 1);
-  if (!(tempOutput = calloc((totalBlocks*64)+1, sizeof(unsigned char *)))) {
-    fprintf(stderr, "ERROR - CHACHA20: calloc failed to allocate a buffer.\n");
-    return ERR_ALLOC;
-  }
-  memcpy(tempOutput, input, inputLen);
+  CRYPTO_STAT_BEGIN(STAT_OP_CHACHA20, inLen);
+  CRYPTO_STAT_ADD(STAT_CHACHA20_CALLS, 1);
+  CRYPTO_STAT_ADD(STAT_CHACHA20_BYTES, inLen);
 
-  for (ind = 0; ind < totalBlocks; ind++) {
-    ChaCha20Block(key, nonce, counter+ind, keyStream);
-    for (innerInd = 0; innerInd < 64; innerInd++) {
-      tempOutput[(64*ind)+innerInd] ^= keyStream[innerInd];
+  for (ind = 0; ind < inLen; ind += numBytes) {
+    numBytes = ((inLen - ind) < sizeof(keyStream)) ? (inLen - ind) : sizeof(keyStream);
+    numBlocks = (numBytes + CHACHA_BLOCK_SIZE_BYTES - 1) / CHACHA_BLOCK_SIZE_BYTES;
+    ChaCha20KeyBlocks(chachaKey, counter+(ind/CHACHA_BLOCK_SIZE_BYTES), numBlocks, keyStream);
+    for (innerInd = 0; innerInd < numBytes; innerInd++) {
+      output[ind+innerInd] = input[ind+innerInd] ^ keyStream[innerInd];
     }
-    memset(keyStream, 0, 64);
   }
-  memcpy(output, tempOutput, inputLen);
+  explicit_bzero(keyStream, sizeof(keyStream));
+  CRYPTO_STAT_END(STAT_OP_CHACHA20, inLen);
 
   return 0;
 }
 
+/*  ChaCha20 encryption function
+ */
+int ErikChaCha20Encrypt(unsigned char *input, unsigned int inLen, unsigned char *key, unsigned char *nonce, uint32_t counter, unsigned char *output) {
+  struct chacha20Key chachaKey;
+  int ret;
+
+  if (!(input) || !(key) || !(nonce) || !(output)) {
+    fprintf(stderr, "ERROR - CHACHA20: invalid input to top level function.\n");
+    return ERR_CHACHA_MAIN;
+  }
+  ChaCha20KeyInit(&chachaKey, key, nonce);
+  ret = ChaCha20KeyEncrypt(&chachaKey, input, inLen, counter, output);
+  ChaCha20KeyWipe(&chachaKey);
+
+  return ret;
+}
+
+/* Function to lay out the constant, key and nonce words of a ChaCha20 state
+ * once. The block functions only change the counter word of a copy of it.
+ */
+void ChaCha20KeyInit(struct chacha20Key *chachaKey, unsigned char *key, unsigned char *nonce) {
+  ChaChaInitBlockState(chachaKey->state, key, nonce, 0);
+}
+
+/* Function to wipe a key object once it is no longer needed
+ */
+void ChaCha20KeyWipe(struct chacha20Key *chachaKey) {
+  explicit_bzero(chachaKey, sizeof(struct chacha20Key));
+}
+
 /* ChaCha20 Block Function
 */
-void ChaCha20Block(unsigned char *key, unsigned char *nonce, uint32_t blockCount, unsigned char *output) {
+void ChaCha20KeyBlock(const struct chacha20Key *chachaKey, uint32_t blockCount, unsigned char *output) {
   int ind;
-  uint32_t state[CHACHA_STATE_SIZE] = {0}, stateResult[CHACHA_STATE_SIZE] = {0};
+  uint32_t state[CHACHA_STATE_SIZE], word;
+
   if (!output) {
     fprintf(stderr, "ERROR: output buffer passed to ChaCha20 Block function is NULL! The function will not be performed.\n");
     return;
   }
-  ChaChaInitBlockState(state, key, nonce, blockCount);
-  ChaChaInitBlockState(stateResult, key, nonce, blockCount);
+  CRYPTO_STAT_ADD(STAT_CHACHA20_BLOCKS_SINGLE, 1);
+  memcpy(state, chachaKey->state, sizeof(state));
+  state[12] = blockCount;
   for (ind = 0; ind < 10; ind++) {
     // Column Rounds
     ChaChaQuartRound(&state[0], &state[4], &state[8], &state[12]);
@@ -75,8 +108,317 @@ void ChaCha20Block(unsigned char *key, unsigned char *nonce, uint32_t blockCount
     ChaChaQuartRound(&state[3], &state[4], &state[9], &state[14]);
   }
   for (ind = 0; ind < CHACHA_STATE_SIZE; ind++) {
-    stateResult[ind] += state[ind];
-    memcpy(output+(ind*4), &stateResult[ind], sizeof(uint32_t));
+    word = state[ind] + ((ind == 12) ? blockCount : chachaKey->state[ind]);
+    memcpy(output+(ind*4), &word, sizeof(uint32_t));
+  }
+}
+
+/* ChaCha20 Block Function taking a raw key and nonce
+*/
+void ChaCha20Block(unsigned char *key, unsigned char *nonce, uint32_t blockCount, unsigned char *output) {
+  struct chacha20Key chachaKey;
+
+  ChaCha20KeyInit(&chachaKey, key, nonce);
+  ChaCha20KeyBlock(&chachaKey, blockCount, output);
+  ChaCha20KeyWipe(&chachaKey);
+}
+
+/* Quarter round applied to the same state words of every lane. Each step is a
+ * loop over the lanes so the compiler can map it onto whatever vector unit the
+ * baseline target has.
+ */
+#define CHACHA_PORTABLE_LANES   4
+#define CHACHA_LANE_ROTL(v, n)  (((v) << (n)) | ((v) >> (32 - (n))))
+#define CHACHA_LANE_QUART_ROUND(x, a, b, c, d)                                  \
+  do {                                                                          \
+    int lane;                                                                   \
+    for (lane = 0; lane < CHACHA_PORTABLE_LANES; lane++) {                      \
+      x[a][lane] += x[b][lane]; x[d][lane] ^= x[a][lane];                       \
+      x[d][lane] = CHACHA_LANE_ROTL(x[d][lane], 16);                            \
+      x[c][lane] += x[d][lane]; x[b][lane] ^= x[c][lane];                       \
+      x[b][lane] = CHACHA_LANE_ROTL(x[b][lane], 12);                            \
+      x[a][lane] += x[b][lane]; x[d][lane] ^= x[a][lane];                       \
+      x[d][lane] = CHACHA_LANE_ROTL(x[d][lane], 8);                             \
+      x[c][lane] += x[d][lane]; x[b][lane] ^= x[c][lane];                       \
+      x[b][lane] = CHACHA_LANE_ROTL(x[b][lane], 7);                             \
+    }                                                                           \
+  } while (0)
+
+/* ChaCha20 block function for CHACHA_PORTABLE_LANES independent states at
+ * once. The initial states are lane-major, init[word][lane], and lane's block
+ * goes to outputs[lane].
+ */
+static void ChaCha20BlocksLanesPortable(uint32_t init[CHACHA_STATE_SIZE][CHACHA_LANES], unsigned char **outputs) {
+  int ind, lane;
+  uint32_t x[CHACHA_STATE_SIZE][CHACHA_PORTABLE_LANES], word;
+
+  for (ind = 0; ind < CHACHA_STATE_SIZE; ind++) {
+    memcpy(x[ind], init[ind], sizeof(x[ind]));
+  }
+  for (ind = 0; ind < 10; ind++) {
+    // Column Rounds
+    CHACHA_LANE_QUART_ROUND(x, 0, 4, 8, 12);
+    CHACHA_LANE_QUART_ROUND(x, 1, 5, 9, 13);
+    CHACHA_LANE_QUART_ROUND(x, 2, 6, 10, 14);
+    CHACHA_LANE_QUART_ROUND(x, 3, 7, 11, 15);
+    // Diagonal Rounds
+    CHACHA_LANE_QUART_ROUND(x, 0, 5, 10, 15);
+    CHACHA_LANE_QUART_ROUND(x, 1, 6, 11, 12);
+    CHACHA_LANE_QUART_ROUND(x, 2, 7, 8, 13);
+    CHACHA_LANE_QUART_ROUND(x, 3, 4, 9, 14);
+  }
+  for (lane = 0; lane < CHACHA_PORTABLE_LANES; lane++) {
+    for (ind = 0; ind < CHACHA_STATE_SIZE; ind++) {
+      word = x[ind][lane] + init[ind][lane];
+      memcpy(outputs[lane]+(ind*4), &word, sizeof(uint32_t));
+    }
+  }
+}
+
+#if defined(__x86_64__)
+/* Same kernel with one state word of 8 (AVX2) or 16 (AVX-512) blocks per
+ * register. The 16 and 8 bit rotates are byte shuffles on AVX2. At the end
+ * the words are transposed so each block is written with full width stores.
+ */
+#define CHACHA_AVX2_ROTL(v, n)  _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+#define CHACHA_AVX2_QUART_ROUND(x, a, b, c, d)                                                          \
+  do {                                                                                                  \
+    x[a] = _mm256_add_epi32(x[a], x[b]); x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d], x[a]), rot16); \
+    x[c] = _mm256_add_epi32(x[c], x[d]); x[b] = CHACHA_AVX2_ROTL(_mm256_xor_si256(x[b], x[c]), 12);      \
+    x[a] = _mm256_add_epi32(x[a], x[b]); x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d], x[a]), rot8);  \
+    x[c] = _mm256_add_epi32(x[c], x[d]); x[b] = CHACHA_AVX2_ROTL(_mm256_xor_si256(x[b], x[c]), 7);       \
+  } while (0)
+
+__attribute__((target("avx2")))
+static void ChaCha20BlocksLanesAvx2(uint32_t init[CHACHA_STATE_SIZE][CHACHA_LANES], unsigned char **outputs) {
+  const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                         2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+  const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                        3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+  __m256i x[CHACHA_STATE_SIZE], y[CHACHA_STATE_SIZE], t0, t1, t2, t3;
+  int ind;
+
+  for (ind = 0; ind < CHACHA_STATE_SIZE; ind++) {
+    x[ind] = _mm256_loadu_si256((__m256i *)init[ind]);
+  }
+  for (ind = 0; ind < 10; ind++) {
+    CHACHA_AVX2_QUART_ROUND(x, 0, 4, 8, 12);
+    CHACHA_AVX2_QUART_ROUND(x, 1, 5, 9, 13);
+    CHACHA_AVX2_QUART_ROUND(x, 2, 6, 10, 14);
+    CHACHA_AVX2_QUART_ROUND(x, 3, 7, 11, 15);
+    CHACHA_AVX2_QUART_ROUND(x, 0, 5, 10, 15);
+    CHACHA_AVX2_QUART_ROUND(x, 1, 6, 11, 12);
+    CHACHA_AVX2_QUART_ROUND(x, 2, 7, 8, 13);
+    CHACHA_AVX2_QUART_ROUND(x, 3, 4, 9, 14);
+  }
+  // 4x4 transposes inside each 128b half, y[4*group+lane] then holds words
+  // 4*group..4*group+3 of blocks lane (low half) and 4+lane (high half)
+  for (ind = 0; ind < CHACHA_STATE_SIZE; ind += 4) {
+    t0 = _mm256_add_epi32(x[ind], _mm256_loadu_si256((__m256i *)init[ind]));
+    t1 = _mm256_add_epi32(x[ind+1], _mm256_loadu_si256((__m256i *)init[ind+1]));
+    t2 = _mm256_add_epi32(x[ind+2], _mm256_loadu_si256((__m256i *)init[ind+2]));
+    t3 = _mm256_add_epi32(x[ind+3], _mm256_loadu_si256((__m256i *)init[ind+3]));
+    x[ind] = _mm256_unpacklo_epi32(t0, t1); x[ind+1] = _mm256_unpackhi_epi32(t0, t1);
+    x[ind+2] = _mm256_unpacklo_epi32(t2, t3); x[ind+3] = _mm256_unpackhi_epi32(t2, t3);
+    y[ind] = _mm256_unpacklo_epi64(x[ind], x[ind+2]); y[ind+1] = _mm256_unpackhi_epi64(x[ind], x[ind+2]);
+    y[ind+2] = _mm256_unpacklo_epi64(x[ind+1], x[ind+3]); y[ind+3] = _mm256_unpackhi_epi64(x[ind+1], x[ind+3]);
+  }
+  for (ind = 0; ind < 4; ind++) {
+    _mm256_storeu_si256((__m256i *)outputs[ind], _mm256_permute2x128_si256(y[ind], y[4+ind], 0x20));
+    _mm256_storeu_si256((__m256i *)(outputs[ind]+32), _mm256_permute2x128_si256(y[8+ind], y[12+ind], 0x20));
+    _mm256_storeu_si256((__m256i *)outputs[4+ind], _mm256_permute2x128_si256(y[ind], y[4+ind], 0x31));
+    _mm256_storeu_si256((__m256i *)(outputs[4+ind]+32), _mm256_permute2x128_si256(y[8+ind], y[12+ind], 0x31));
+  }
+}
+
+#define CHACHA_AVX512_QUART_ROUND(x, a, b, c, d)                                                        \
+  do {                                                                                                  \
+    x[a] = _mm512_add_epi32(x[a], x[b]); x[d] = _mm512_rol_epi32(_mm512_xor_si512(x[d], x[a]), 16);      \
+    x[c] = _mm512_add_epi32(x[c], x[d]); x[b] = _mm512_rol_epi32(_mm512_xor_si512(x[b], x[c]), 12);      \
+    x[a] = _mm512_add_epi32(x[a], x[b]); x[d] = _mm512_rol_epi32(_mm512_xor_si512(x[d], x[a]), 8);       \
+    x[c] = _mm512_add_epi32(x[c], x[d]); x[b] = _mm512_rol_epi32(_mm512_xor_si512(x[b], x[c]), 7);       \
+  } while (0)
+
+__attribute__((target("avx512f")))
+static void ChaCha20BlocksLanesAvx512(uint32_t init[CHACHA_STATE_SIZE][CHACHA_LANES], unsigned char **outputs) {
+  __m512i x[CHACHA_STATE_SIZE], y[CHACHA_STATE_SIZE], t0, t1, t2, t3;
+  int ind;
+
+  for (ind = 0; ind < CHACHA_STATE_SIZE; ind++) {
+    x[ind] = _mm512_loadu_si512(init[ind]);
+  }
+  for (ind = 0; ind < 10; ind++) {
+    CHACHA_AVX512_QUART_ROUND(x, 0, 4, 8, 12);
+    CHACHA_AVX512_QUART_ROUND(x, 1, 5, 9, 13);
+    CHACHA_AVX512_QUART_ROUND(x, 2, 6, 10, 14);
+    CHACHA_AVX512_QUART_ROUND(x, 3, 7, 11, 15);
+    CHACHA_AVX512_QUART_ROUND(x, 0, 5, 10, 15);
+    CHACHA_AVX512_QUART_ROUND(x, 1, 6, 11, 12);
+    CHACHA_AVX512_QUART_ROUND(x, 2, 7, 8, 13);
+    CHACHA_AVX512_QUART_ROUND(x, 3, 4, 9, 14);
+  }
+  // 4x4 transposes inside each 128b quarter, y[4*group+lane] then holds words
+  // 4*group..4*group+3 of block 4*quarter+lane in each quarter
+  for (ind = 0; ind < CHACHA_STATE_SIZE; ind += 4) {
+    t0 = _mm512_add_epi32(x[ind], _mm512_loadu_si512(init[ind]));
+    t1 = _mm512_add_epi32(x[ind+1], _mm512_loadu_si512(init[ind+1]));
+    t2 = _mm512_add_epi32(x[ind+2], _mm512_loadu_si512(init[ind+2]));
+    t3 = _mm512_add_epi32(x[ind+3], _mm512_loadu_si512(init[ind+3]));
+    x[ind] = _mm512_unpacklo_epi32(t0, t1); x[ind+1] = _mm512_unpackhi_epi32(t0, t1);
+    x[ind+2] = _mm512_unpacklo_epi32(t2, t3); x[ind+3] = _mm512_unpackhi_epi32(t2, t3);
+    y[ind] = _mm512_unpacklo_epi64(x[ind], x[ind+2]); y[ind+1] = _mm512_unpackhi_epi64(x[ind], x[ind+2]);
+    y[ind+2] = _mm512_unpacklo_epi64(x[ind+1], x[ind+3]); y[ind+3] = _mm512_unpackhi_epi64(x[ind+1], x[ind+3]);
+  }
+  // Then a 4x4 transpose of the 128b quarters of the four groups
+  for (ind = 0; ind < 4; ind++) {
+    t0 = _mm512_shuffle_i32x4(y[ind], y[4+ind], 0x44);
+    t1 = _mm512_shuffle_i32x4(y[8+ind], y[12+ind], 0x44);
+    t2 = _mm512_shuffle_i32x4(y[ind], y[4+ind], 0xee);
+    t3 = _mm512_shuffle_i32x4(y[8+ind], y[12+ind], 0xee);
+    _mm512_storeu_si512(outputs[ind], _mm512_shuffle_i32x4(t0, t1, 0x88));
+    _mm512_storeu_si512(outputs[4+ind], _mm512_shuffle_i32x4(t0, t1, 0xdd));
+    _mm512_storeu_si512(outputs[8+ind], _mm512_shuffle_i32x4(t2, t3, 0x88));
+    _mm512_storeu_si512(outputs[12+ind], _mm512_shuffle_i32x4(t2, t3, 0xdd));
+  }
+}
+#endif
+
+/* Multi-block kernels by backend, the lane count is how many blocks one call
+ * computes and statCounter the blocks counter of the backend. Unsupported
+ * backends are left empty.
+ */
+struct chachaLanesKernel {
+  void (*blocksLanes)(uint32_t init[CHACHA_STATE_SIZE][CHACHA_LANES], unsigned char **outputs);
+  unsigned int lanes;
+  enum cryptoStatCounter statCounter;
+};
+
+static struct chachaLanesKernel chachaKernels[CHACHA_BACKEND_AVX512+1];
+static int chachaBestBackend = CHACHA_BACKEND_PORTABLE;
+static pthread_once_t chachaKernelsOnce = PTHREAD_ONCE_INIT;
+
+static void ChaCha20InitKernels(void) {
+  chachaKernels[CHACHA_BACKEND_PORTABLE].blocksLanes = ChaCha20BlocksLanesPortable;
+  chachaKernels[CHACHA_BACKEND_PORTABLE].lanes = CHACHA_PORTABLE_LANES;
+  chachaKernels[CHACHA_BACKEND_PORTABLE].statCounter = STAT_CHACHA20_BLOCKS_PORTABLE;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    chachaKernels[CHACHA_BACKEND_AVX2].blocksLanes = ChaCha20BlocksLanesAvx2;
+    chachaKernels[CHACHA_BACKEND_AVX2].lanes = 8;
+    chachaKernels[CHACHA_BACKEND_AVX2].statCounter = STAT_CHACHA20_BLOCKS_AVX2;
+    chachaBestBackend = CHACHA_BACKEND_AVX2;
+  }
+  if (__builtin_cpu_supports("avx512f")) {
+    chachaKernels[CHACHA_BACKEND_AVX512].blocksLanes = ChaCha20BlocksLanesAvx512;
+    chachaKernels[CHACHA_BACKEND_AVX512].lanes = 16;
+    chachaKernels[CHACHA_BACKEND_AVX512].statCounter = STAT_CHACHA20_BLOCKS_AVX512;
+    chachaBestBackend = CHACHA_BACKEND_AVX512;
+  }
+#endif
+}
+
+// Function returning the kernel of a backend, NULL if the CPU lacks it
+static const struct chachaLanesKernel *ChaCha20GetKernel(int backend) {
+  pthread_once(&chachaKernelsOnce, ChaCha20InitKernels);
+  if (backend == CHACHA_BACKEND_BEST) {
+    backend = chachaBestBackend;
+  }
+  if ((backend < CHACHA_BACKEND_PORTABLE) || (backend > CHACHA_BACKEND_AVX512) || !chachaKernels[backend].lanes) {
+    return NULL;
+  }
+  return &chachaKernels[backend];
+}
+
+/* Function returning the blocks per multi-block kernel call of a backend, 0
+ * if the CPU does not support it
+ */
+unsigned int ChaCha20BackendLanes(int backend) {
+  const struct chachaLanesKernel *kernel = ChaCha20GetKernel(backend);
+
+  return kernel ? kernel->lanes : 0;
+}
+
+/* ChaCha20 keystream for numBlocks consecutive blocks starting at blockCount
+ * with a specific backend. The key words are broadcast to every lane once,
+ * full groups of lanes go through the multi-block kernel and the remainder
+ * through the single block function.
+ */
+int ChaCha20KeyBlocksBackend(const struct chacha20Key *chachaKey, uint32_t blockCount, unsigned int numBlocks, unsigned char *output, int backend) {
+  const struct chachaLanesKernel *kernel = ChaCha20GetKernel(backend);
+  unsigned int ind = 0, lanes;
+  int word, lane;
+  uint32_t init[CHACHA_STATE_SIZE][CHACHA_LANES];
+  unsigned char *outputs[CHACHA_LANES];
+
+  if (!output || !chachaKey) {
+    fprintf(stderr, "ERROR: key or output buffer passed to ChaCha20 Blocks function is NULL! The function will not be performed.\n");
+    return ERR_CHACHA_MAIN;
+  }
+  if (!kernel) {
+    return ERR_CHACHA_MAIN;
+  }
+  lanes = kernel->lanes;
+  if (numBlocks >= lanes) {
+    for (word = 0; word < CHACHA_STATE_SIZE; word++) {
+      for (lane = 0; lane < CHACHA_LANES; lane++) {
+        init[word][lane] = chachaKey->state[word];
+      }
+    }
+  }
+  for (; (ind + lanes) <= numBlocks; ind += lanes) {
+    for (lane = 0; lane < (int)lanes; lane++) {
+      init[12][lane] = blockCount + ind + lane;
+      outputs[lane] = output+((ind+lane)*CHACHA_BLOCK_SIZE_BYTES);
+    }
+    CRYPTO_STAT_ADD(kernel->statCounter, lanes);
+    kernel->blocksLanes(init, outputs);
+  }
+  for (; ind < numBlocks; ind++) {
+    ChaCha20KeyBlock(chachaKey, blockCount+ind, output+(ind*CHACHA_BLOCK_SIZE_BYTES));
+  }
+
+  return 0;
+}
+
+/* ChaCha20 keystream for numBlocks consecutive blocks with the widest kernel
+ * the CPU supports
+ */
+void ChaCha20KeyBlocks(const struct chacha20Key *chachaKey, uint32_t blockCount, unsigned int numBlocks, unsigned char *output) {
+  ChaCha20KeyBlocksBackend(chachaKey, blockCount, numBlocks, output, CHACHA_BACKEND_BEST);
+}
+
+/* ChaCha20 keystream for numBlocks consecutive blocks taking a raw key and nonce
+ */
+void ChaCha20Blocks(unsigned char *key, unsigned char *nonce, uint32_t blockCount, unsigned int numBlocks, unsigned char *output) {
+  struct chacha20Key chachaKey;
+
+  ChaCha20KeyInit(&chachaKey, key, nonce);
+  ChaCha20KeyBlocks(&chachaKey, blockCount, numBlocks, output);
+  ChaCha20KeyWipe(&chachaKey);
+}
+
+/* ChaCha20 keystream for numBlocks unrelated blocks, block i using keys[i]
+ * and blockCounts[i]. Lets many short messages under different keys share
+ * the multi-block kernel.
+ */
+void ChaCha20BlocksGather(const struct chacha20Key **keys, uint32_t *blockCounts, unsigned int numBlocks, unsigned char **outputs) {
+  const struct chachaLanesKernel *kernel = ChaCha20GetKernel(CHACHA_BACKEND_BEST);
+  unsigned int ind = 0, lanes = kernel->lanes;
+  int word, lane;
+  uint32_t init[CHACHA_STATE_SIZE][CHACHA_LANES];
+
+  for (; (ind + lanes) <= numBlocks; ind += lanes) {
+    for (lane = 0; lane < (int)lanes; lane++) {
+      for (word = 0; word < CHACHA_STATE_SIZE; word++) {
+        init[word][lane] = keys[ind+lane]->state[word];
+      }
+      init[12][lane] = blockCounts[ind+lane];
+    }
+    CRYPTO_STAT_ADD(kernel->statCounter, lanes);
+    kernel->blocksLanes(init, outputs+ind);
+  }
+  for (; ind < numBlocks; ind++) {
+    ChaCha20KeyBlock(keys[ind], blockCounts[ind], outputs[ind]);
   }
 }
 
@@ -118,10 +460,107 @@ void PrintChaCha20State(uint32_t *state) {
   }
 }
 
-int ErikGenPoly1305(unsigned char *input, unsigned char *key, unsigned char *tag) {
-  unsigned char *r, *s;
+/* Poly1305 one time authenticator (RFC 8439 section 2.5). The 130 bit
+ * accumulator is kept in five 26 bit limbs so every product fits in 64 bits.
+ */
+#define POLY_LIMB_MASK  0x3ffffff
+
+static uint32_t PolyLoad32(unsigned char *buff) {
+  return (uint32_t)buff[0] | ((uint32_t)buff[1] << 8) | ((uint32_t)buff[2] << 16) | ((uint32_t)buff[3] << 24);
+}
+
+static void PolyStore32(unsigned char *buff, uint32_t word) {
+  buff[0] = word; buff[1] = word >> 8; buff[2] = word >> 16; buff[3] = word >> 24;
+}
+
+int ErikGenPoly1305(unsigned char *input, unsigned long inLen, unsigned char *key, unsigned char *tag) {
+  unsigned char r[16], block[POLY1305_BLOCK_SIZE_BYTES];
+  uint32_t r0, r1, r2, r3, r4, s1, s2, s3, s4;
+  uint32_t h0 = 0, h1 = 0, h2 = 0, h3 = 0, h4 = 0;
+  uint32_t g0, g1, g2, g3, g4, c, mask, hibit;
+  uint64_t d0, d1, d2, d3, d4, f;
+  unsigned long offset, take;
+
+  if ((!input && inLen) || !key || !tag) {
+    fprintf(stderr, "ERROR - POLY1305: invalid input to top level function.\n");
+    return ERR_POLY1305_MAIN;
+  }
+  memcpy(r, key, 16);
+  PolyClamp(r);
+  r0 = PolyLoad32(r) & POLY_LIMB_MASK;
+  r1 = (PolyLoad32(r+3) >> 2) & POLY_LIMB_MASK;
+  r2 = (PolyLoad32(r+6) >> 4) & POLY_LIMB_MASK;
+  r3 = (PolyLoad32(r+9) >> 6) & POLY_LIMB_MASK;
+  r4 = (PolyLoad32(r+12) >> 8) & POLY_LIMB_MASK;
+  s1 = r1 * 5; s2 = r2 * 5; s3 = r3 * 5; s4 = r4 * 5;
+
+  for (offset = 0; offset < inLen; offset += take) {
+    take = inLen - offset;
+    if (take >= POLY1305_BLOCK_SIZE_BYTES) {
+      take = POLY1305_BLOCK_SIZE_BYTES;
+      memcpy(block, input+offset, POLY1305_BLOCK_SIZE_BYTES);
+      hibit = 1 << 24;
+    } else {
+      // A short final block gets its 0x01 byte inside the block instead of at bit 128
+      memset(block, 0, POLY1305_BLOCK_SIZE_BYTES);
+      memcpy(block, input+offset, take);
+      block[take] = 1;
+      hibit = 0;
+    }
+    h0 += PolyLoad32(block) & POLY_LIMB_MASK;
+    h1 += (PolyLoad32(block+3) >> 2) & POLY_LIMB_MASK;
+    h2 += (PolyLoad32(block+6) >> 4) & POLY_LIMB_MASK;
+    h3 += (PolyLoad32(block+9) >> 6) & POLY_LIMB_MASK;
+    h4 += (PolyLoad32(block+12) >> 8) | hibit;
+
+    // h *= r mod 2^130 - 5, limbs above 2^130 wrap around multiplied by 5
+    d0 = ((uint64_t)h0 * r0) + ((uint64_t)h1 * s4) + ((uint64_t)h2 * s3) + ((uint64_t)h3 * s2) + ((uint64_t)h4 * s1);
+    d1 = ((uint64_t)h0 * r1) + ((uint64_t)h1 * r0) + ((uint64_t)h2 * s4) + ((uint64_t)h3 * s3) + ((uint64_t)h4 * s2);
+    d2 = ((uint64_t)h0 * r2) + ((uint64_t)h1 * r1) + ((uint64_t)h2 * r0) + ((uint64_t)h3 * s4) + ((uint64_t)h4 * s3);
+    d3 = ((uint64_t)h0 * r3) + ((uint64_t)h1 * r2) + ((uint64_t)h2 * r1) + ((uint64_t)h3 * r0) + ((uint64_t)h4 * s4);
+    d4 = ((uint64_t)h0 * r4) + ((uint64_t)h1 * r3) + ((uint64_t)h2 * r2) + ((uint64_t)h3 * r1) + ((uint64_t)h4 * r0);
+
+    c = d0 >> 26; h0 = d0 & POLY_LIMB_MASK;
+    d1 += c; c = d1 >> 26; h1 = d1 & POLY_LIMB_MASK;
+    d2 += c; c = d2 >> 26; h2 = d2 & POLY_LIMB_MASK;
+    d3 += c; c = d3 >> 26; h3 = d3 & POLY_LIMB_MASK;
+    d4 += c; c = d4 >> 26; h4 = d4 & POLY_LIMB_MASK;
+    h0 += c * 5; c = h0 >> 26; h0 &= POLY_LIMB_MASK;
+    h1 += c;
+  }
+
+  // Fully carry h, then subtract p if h >= p without branching
+  c = h1 >> 26; h1 &= POLY_LIMB_MASK;
+  h2 += c; c = h2 >> 26; h2 &= POLY_LIMB_MASK;
+  h3 += c; c = h3 >> 26; h3 &= POLY_LIMB_MASK;
+  h4 += c; c = h4 >> 26; h4 &= POLY_LIMB_MASK;
+  h0 += c * 5; c = h0 >> 26; h0 &= POLY_LIMB_MASK;
+  h1 += c;
+
+  g0 = h0 + 5; c = g0 >> 26; g0 &= POLY_LIMB_MASK;
+  g1 = h1 + c; c = g1 >> 26; g1 &= POLY_LIMB_MASK;
+  g2 = h2 + c; c = g2 >> 26; g2 &= POLY_LIMB_MASK;
+  g3 = h3 + c; c = g3 >> 26; g3 &= POLY_LIMB_MASK;
+  g4 = h4 + c - (1 << 26);
+
+  mask = (g4 >> 31) - 1;
+  h0 = (h0 & ~mask) | (g0 & mask);
+  h1 = (h1 & ~mask) | (g1 & mask);
+  h2 = (h2 & ~mask) | (g2 & mask);
+  h3 = (h3 & ~mask) | (g3 & mask);
+  h4 = (h4 & ~mask) | (g4 & mask);
 
-  
+  // tag = (h + s) mod 2^128
+  h0 = h0 | (h1 << 26);
+  h1 = (h1 >> 6) | (h2 << 20);
+  h2 = (h2 >> 12) | (h3 << 14);
+  h3 = (h3 >> 18) | (h4 << 8);
+  f = (uint64_t)h0 + PolyLoad32(key+16); PolyStore32(tag, f);
+  f = (uint64_t)h1 + PolyLoad32(key+20) + (f >> 32); PolyStore32(tag+4, f);
+  f = (uint64_t)h2 + PolyLoad32(key+24) + (f >> 32); PolyStore32(tag+8, f);
+  f = (uint64_t)h3 + PolyLoad32(key+28) + (f >> 32); PolyStore32(tag+12, f);
+
+  return 0;
 }
 
 void PolyClamp(unsigned char *r) {
@@ -132,4 +571,161 @@ void PolyClamp(unsigned char *r) {
   r[4] &= 0xFC;
   r[8] &= 0xFC;
   r[12] &= 0xFC;
-}
\ No newline at end of file
+}
+
+// Function to compute the RFC 8439 tag over the padded AAD, ciphertext and both lengths
+static int ChaCha20Poly1305Mac(unsigned char *cipher, unsigned long inLen, unsigned char *aad, unsigned long aadLen,
+                               unsigned char *polyKey, unsigned char *tag) {
+  unsigned long ind, macLen, aadPadded = (aadLen + 15) & ~15UL, inPadded = (inLen + 15) & ~15UL;
+  unsigned char *macData;
+  int ret;
+
+  macLen = aadPadded + inPadded + 16;
+  if (!(macData = calloc(macLen, sizeof(unsigned char)))) {
+    fprintf(stderr, "ERROR - CHACHA20 POLY1305: calloc failed to allocate a buffer.\n");
+    return ERR_ALLOC;
+  }
+  if (aadLen) {
+    memcpy(macData, aad, aadLen);
+  }
+  if (inLen) {
+    memcpy(macData+aadPadded, cipher, inLen);
+  }
+  for (ind = 0; ind < 8; ind++) {
+    macData[aadPadded+inPadded+ind] = (aadLen >> (8*ind)) & 0xff;
+    macData[aadPadded+inPadded+8+ind] = (inLen >> (8*ind)) & 0xff;
+  }
+  ret = ErikGenPoly1305(macData, macLen, polyKey, tag);
+  free(macData); macData = NULL;
+
+  return ret;
+}
+
+/* ChaCha20-Poly1305 AEAD encryption (RFC 8439 section 2.8). polyKey is the
+ * first half of keystream block 0; keyStream holds blocks 1 onwards for the
+ * message. Both are passed in so batched callers can produce them together.
+ */
+int ChaCha20Poly1305Seal(unsigned char *input, unsigned long inLen, unsigned char *aad, unsigned long aadLen,
+                         unsigned char *polyKey, unsigned char *keyStream, unsigned char *output, unsigned char *tag) {
+  unsigned long ind;
+
+  if (!polyKey || !tag || (!aad && aadLen) || ((!input || !keyStream || !output) && inLen)) {
+    fprintf(stderr, "ERROR - CHACHA20 POLY1305: invalid input to ChaCha20Poly1305Seal.\n");
+    return ERR_POLY1305_MAIN;
+  }
+  for (ind = 0; ind < inLen; ind++) {
+    output[ind] = input[ind] ^ keyStream[ind];
+  }
+
+  return ChaCha20Poly1305Mac(output, inLen, aad, aadLen, polyKey, tag);
+}
+
+/* ChaCha20-Poly1305 AEAD decryption, the counterpart of ChaCha20Poly1305Seal.
+ * input is the ciphertext and tag the one received with it. The tag is checked
+ * in constant time before anything is decrypted, on a mismatch output is left
+ * untouched and ERR_POLY1305_AUTH is returned.
+ */
+int ChaCha20Poly1305Open(unsigned char *input, unsigned long inLen, unsigned char *aad, unsigned long aadLen,
+                         unsigned char *polyKey, unsigned char *keyStream, unsigned char *output, unsigned char *tag) {
+  unsigned char expected[POLY1305_TAG_SIZE_BYTES], diff = 0;
+  unsigned long ind;
+  int ret;
+
+  if (!polyKey || !tag || (!aad && aadLen) || ((!input || !keyStream || !output) && inLen)) {
+    fprintf(stderr, "ERROR - CHACHA20 POLY1305: invalid input to ChaCha20Poly1305Open.\n");
+    return ERR_POLY1305_MAIN;
+  }
+  if ((ret = ChaCha20Poly1305Mac(input, inLen, aad, aadLen, polyKey, expected))) {
+    return ret;
+  }
+  for (ind = 0; ind < POLY1305_TAG_SIZE_BYTES; ind++) {
+    diff |= expected[ind] ^ tag[ind];
+  }
+  explicit_bzero(expected, sizeof(expected));
+  if (diff) {
+    return ERR_POLY1305_AUTH;
+  }
+  for (ind = 0; ind < inLen; ind++) {
+    output[ind] = input[ind] ^ keyStream[ind];
+  }
+
+  return 0;
+}
+
+// Function to run Seal or Open off a key object, the keystream is generated here
+static int ChaCha20Poly1305KeyRun(const struct chacha20Key *chachaKey, unsigned char *input, unsigned long inLen,
+                                  unsigned char *aad, unsigned long aadLen, unsigned char *output, unsigned char *tag, int open) {
+  unsigned long numBlocks = (inLen + CHACHA_BLOCK_SIZE_BYTES - 1) / CHACHA_BLOCK_SIZE_BYTES;
+  unsigned char *keyStream;
+  int ret;
+
+  if (!chachaKey || (!input && inLen) || (!aad && aadLen) || (!output && inLen) || !tag) {
+    fprintf(stderr, "ERROR - CHACHA20 POLY1305: invalid input to top level function.\n");
+    return ERR_POLY1305_MAIN;
+  }
+  if (!(keyStream = calloc((numBlocks+1)*CHACHA_BLOCK_SIZE_BYTES, sizeof(unsigned char)))) {
+    fprintf(stderr, "ERROR - CHACHA20 POLY1305: calloc failed to allocate a buffer.\n");
+    return ERR_ALLOC;
+  }
+  ChaCha20KeyBlocks(chachaKey, 0, numBlocks+1, keyStream);
+  if (open) {
+    ret = ChaCha20Poly1305Open(input, inLen, aad, aadLen, keyStream, keyStream+CHACHA_BLOCK_SIZE_BYTES, output, tag);
+  } else {
+    ret = ChaCha20Poly1305Seal(input, inLen, aad, aadLen, keyStream, keyStream+CHACHA_BLOCK_SIZE_BYTES, output, tag);
+  }
+  explicit_bzero(keyStream, (numBlocks+1)*CHACHA_BLOCK_SIZE_BYTES);
+  free(keyStream); keyStream = NULL;
+
+  return ret;
+}
+
+/* ChaCha20-Poly1305 AEAD encryption with a precomputed key object
+ */
+int ChaCha20Poly1305KeyEncrypt(const struct chacha20Key *chachaKey, unsigned char *input, unsigned long inLen,
+                               unsigned char *aad, unsigned long aadLen, unsigned char *output, unsigned char *tag) {
+  return ChaCha20Poly1305KeyRun(chachaKey, input, inLen, aad, aadLen, output, tag, 0);
+}
+
+/* ChaCha20-Poly1305 AEAD decryption with a precomputed key object
+ */
+int ChaCha20Poly1305KeyDecrypt(const struct chacha20Key *chachaKey, unsigned char *input, unsigned long inLen,
+                               unsigned char *aad, unsigned long aadLen, unsigned char *output, unsigned char *tag) {
+  return ChaCha20Poly1305KeyRun(chachaKey, input, inLen, aad, aadLen, output, tag, 1);
+}
+
+/* ChaCha20-Poly1305 AEAD encryption function
+ */
+int ErikChaCha20Poly1305Encrypt(unsigned char *input, unsigned long inLen, unsigned char *aad, unsigned long aadLen,
+                                unsigned char *key, unsigned char *nonce, unsigned char *output, unsigned char *tag) {
+  struct chacha20Key chachaKey;
+  int ret;
+
+  if (!key || !nonce) {
+    fprintf(stderr, "ERROR - CHACHA20 POLY1305: invalid input to top level function.\n");
+    return ERR_POLY1305_MAIN;
+  }
+  ChaCha20KeyInit(&chachaKey, key, nonce);
+  ret = ChaCha20Poly1305KeyEncrypt(&chachaKey, input, inLen, aad, aadLen, output, tag);
+  ChaCha20KeyWipe(&chachaKey);
+
+  return ret;
+}
+
+/* ChaCha20-Poly1305 AEAD decryption function, returns ERR_POLY1305_AUTH when
+ * the tag does not match
+ */
+int ErikChaCha20Poly1305Decrypt(unsigned char *input, unsigned long inLen, unsigned char *aad, unsigned long aadLen,
+                                unsigned char *key, unsigned char *nonce, unsigned char *output, unsigned char *tag) {
+  struct chacha20Key chachaKey;
+  int ret;
+
+  if (!key || !nonce) {
+    fprintf(stderr, "ERROR - CHACHA20 POLY1305: invalid input to top level function.\n");
+    return ERR_POLY1305_MAIN;
+  }
+  ChaCha20KeyInit(&chachaKey, key, nonce);
+  ret = ChaCha20Poly1305KeyDecrypt(&chachaKey, input, inLen, aad, aadLen, output, tag);
+  ChaCha20KeyWipe(&chachaKey);
+
+  return ret;
+}
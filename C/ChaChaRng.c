@@ -0,0 +1,144 @@
+/* Description: ChaCha20 based CSPRNG with a per-thread keystream buffer
+ * References:  - RFC 8439
+ *              - https://blog.cr.yp.to/20170723-random.html (fast key erasure)
+ *
+ * Each thread seeds a 256 bit key from getrandom and expands it with the
+ * multi-block ChaCha20 kernel into a buffer of keystream. The first 32 bytes
+ * of every refill become the next key and are wiped from the buffer, so a
+ * compromised state never reveals output that was already handed out. Bytes
+ * are wiped from the buffer as they are returned.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include "Crypto.h"
+
+// Keystream blocks generated per refill of a thread's buffer
+#define CHACHA_RNG_REFILL_BLOCKS  64
+#define CHACHA_RNG_BUFF_BYTES     (CHACHA_RNG_REFILL_BLOCKS * CHACHA_BLOCK_SIZE_BYTES)
+// Max blocks generated straight into a caller's buffer under one erased key
+#define CHACHA_RNG_DIRECT_BLOCKS  (1 << 16)
+
+struct chachaRngState {
+  struct chacha20Key key;
+  unsigned char buff[CHACHA_RNG_BUFF_BYTES];
+  unsigned int buffPos;
+  int seeded;
+};
+
+static __thread struct chachaRngState rngState;
+static pthread_once_t rngAtforkOnce = PTHREAD_ONCE_INIT;
+// Every key is only used once, so a fixed nonce is fine
+static unsigned char rngNonce[CHACHA_NONCE_SIZE_BYTES] = {0};
+
+/* Fork handler run in the child. Only the forking thread survives, so wiping
+ * its state forces a fresh getrandom seed instead of repeating the parent's
+ * stream.
+ */
+static void ChaChaRngAtforkChild(void) {
+  explicit_bzero(&rngState, sizeof(rngState));
+}
+
+static void ChaChaRngRegisterAtfork(void) {
+  pthread_atfork(NULL, NULL, ChaChaRngAtforkChild);
+}
+
+/* Expand the current key into a full buffer and rekey from its first bytes
+ */
+static void ChaChaRngRefill(struct chachaRngState *st) {
+  CRYPTO_STAT_ADD(STAT_RNG_REFILLS, 1);
+  ChaCha20KeyBlocks(&st->key, 0, CHACHA_RNG_REFILL_BLOCKS, st->buff);
+  ChaCha20KeyInit(&st->key, st->buff, rngNonce);
+  memset(st->buff, 0, CHACHA_KEY_SIZE_BYTES);
+  st->buffPos = CHACHA_KEY_SIZE_BYTES;
+}
+
+/* Seed the calling thread's key from the kernel
+ */
+static int ChaChaRngSeed(struct chachaRngState *st) {
+  unsigned char seed[CHACHA_KEY_SIZE_BYTES];
+  unsigned int got = 0;
+  ssize_t ret;
+
+  pthread_once(&rngAtforkOnce, ChaChaRngRegisterAtfork);
+  while (got < CHACHA_KEY_SIZE_BYTES) {
+    ret = getrandom(seed+got, CHACHA_KEY_SIZE_BYTES-got, 0);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "ERROR - CHACHA RNG: getrandom failed with errno %d.\n", errno);
+      explicit_bzero(seed, CHACHA_KEY_SIZE_BYTES);
+      return ERR_CHACHA_RNG;
+    }
+    got += ret;
+  }
+  ChaCha20KeyInit(&st->key, seed, rngNonce);
+  explicit_bzero(seed, CHACHA_KEY_SIZE_BYTES);
+  ChaChaRngRefill(st);
+  st->seeded = 1;
+
+  return 0;
+}
+
+/* Fill output with outLen cryptographically secure random bytes
+ */
+int ErikChaChaRngBytes(unsigned char *output, unsigned long outLen) {
+  struct chachaRngState *st = &rngState;
+  struct chacha20Key oneTimeKey;
+  unsigned long take;
+
+  if (!output && outLen) {
+    fprintf(stderr, "ERROR - CHACHA RNG: NULL output buffer passed with a non zero length %lu.\n", outLen);
+    return ERR_CHACHA_RNG;
+  }
+  if (!st->seeded && ChaChaRngSeed(st)) {
+    return ERR_CHACHA_RNG;
+  }
+  CRYPTO_STAT_ADD(STAT_RNG_CALLS, 1);
+  CRYPTO_STAT_ADD(STAT_RNG_BYTES, outLen);
+
+  // Small requests are served straight out of the buffer
+  if (outLen <= (CHACHA_RNG_BUFF_BYTES - st->buffPos)) {
+    memcpy(output, st->buff+st->buffPos, outLen);
+    memset(st->buff+st->buffPos, 0, outLen);
+    st->buffPos += outLen;
+    return 0;
+  }
+
+  while (outLen) {
+    if (st->buffPos == CHACHA_RNG_BUFF_BYTES) {
+      ChaChaRngRefill(st);
+    }
+    if ((outLen >= CHACHA_RNG_BUFF_BYTES) && ((CHACHA_RNG_BUFF_BYTES - st->buffPos) >= CHACHA_KEY_SIZE_BYTES)) {
+      // Large requests take a one time key from the buffer and are generated in place
+      take = outLen / CHACHA_BLOCK_SIZE_BYTES;
+      if (take > CHACHA_RNG_DIRECT_BLOCKS) {
+        take = CHACHA_RNG_DIRECT_BLOCKS;
+      }
+      ChaCha20KeyInit(&oneTimeKey, st->buff+st->buffPos, rngNonce);
+      memset(st->buff+st->buffPos, 0, CHACHA_KEY_SIZE_BYTES);
+      st->buffPos += CHACHA_KEY_SIZE_BYTES;
+      ChaCha20KeyBlocks(&oneTimeKey, 0, take, output);
+      take *= CHACHA_BLOCK_SIZE_BYTES;
+    } else {
+      take = CHACHA_RNG_BUFF_BYTES - st->buffPos;
+      if (take > outLen) {
+        take = outLen;
+      }
+      memcpy(output, st->buff+st->buffPos, take);
+      memset(st->buff+st->buffPos, 0, take);
+      st->buffPos += take;
+    }
+    output += take;
+    outLen -= take;
+  }
+  ChaCha20KeyWipe(&oneTimeKey);
+
+  return 0;
+}
@@ -0,0 +1,186 @@
+/* Description: Compile time checks of CryptoConstexpr.hpp
+ *
+ * The SHA256 vectors are the ones in Sha256Regression.txt and the ChaCha20
+ * ones come from ChaCha20Regression.txt, both included as tables the
+ * Makefile generates. Every vector is checked twice: by static_assert while
+ * compiling, and at runtime against the C implementation so both stay pinned
+ * to the same answers.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "Crypto.h"
+#include "CryptoConstexpr.hpp"
+
+using namespace CryptoConstexpr;
+
+struct Sha256Vector {
+  std::string_view input;
+  std::string_view digestHex;
+};
+
+struct ChaCha20Vector {
+  std::string_view input;
+  bool inputHex;
+  std::string_view keyHex;
+  std::string_view nonceHex;
+  uint32_t counter;
+  std::string_view cipherHex;
+};
+
+// Both tables are generated by the Makefile (GenVectors.awk) from the same
+// regression files FunctionTest.c reads, so an edited vector is picked up here
+constexpr Sha256Vector sha256Vectors[] = {
+#include "Sha256Vectors.inc"
+};
+constexpr std::size_t numSha256Vectors = sizeof(sha256Vectors) / sizeof(sha256Vectors[0]);
+
+constexpr ChaCha20Vector chachaVectors[] = {
+#include "ChaCha20Vectors.inc"
+};
+constexpr std::size_t numChaChaVectors = sizeof(chachaVectors) / sizeof(chachaVectors[0]);
+
+// Function to parse the byte at a given index of a hex string_view
+constexpr uint8_t HexByte(std::string_view hex, std::size_t index) {
+  uint8_t output = 0;
+
+  for (std::size_t ind = 2 * index; ind < (2 * index) + 2; ind++) {
+    char digit = hex[ind];
+    uint8_t nibble = (digit >= 'a') ? (digit - 'a' + 10) : ((digit >= 'A') ? (digit - 'A' + 10) : (digit - '0'));
+    output = uint8_t((output << 4) | nibble);
+  }
+  return output;
+}
+
+template <std::size_t N>
+constexpr std::array<uint8_t, N> ArrayFromHex(std::string_view hex) {
+  std::array<uint8_t, N> output = {};
+
+  for (std::size_t ind = 0; ind < N; ind++) {
+    output[ind] = HexByte(hex, ind);
+  }
+  return output;
+}
+
+constexpr std::size_t ChaChaInputBytes(const ChaCha20Vector &vec) {
+  return vec.inputHex ? (vec.input.size() / 2) : vec.input.size();
+}
+
+constexpr uint8_t ChaChaInputByte(const ChaCha20Vector &vec, std::size_t index) {
+  return vec.inputHex ? HexByte(vec.input, index) : uint8_t(vec.input[index]);
+}
+
+constexpr bool CheckSha256Vector(const Sha256Vector &vec) {
+  return (vec.digestHex.size() == (2 * sha256OutputBytes))
+         && Equal(Sha256(vec.input), ArrayFromHex<sha256OutputBytes>(vec.digestHex));
+}
+
+// Same keystream walk as ChaCha20Encrypt, sized at runtime by the vector
+constexpr bool CheckChaChaVector(const ChaCha20Vector &vec) {
+  ChaChaKey key = {};
+  ChaChaNonce nonce = {};
+  ChaChaBlock keyStream = {};
+
+  if ((vec.keyHex.size() != (2 * chachaKeyBytes)) || (vec.nonceHex.size() != (2 * chachaNonceBytes))
+      || (vec.cipherHex.size() != (2 * ChaChaInputBytes(vec)))) {
+    return false;
+  }
+  key = ArrayFromHex<chachaKeyBytes>(vec.keyHex);
+  nonce = ArrayFromHex<chachaNonceBytes>(vec.nonceHex);
+  for (std::size_t ind = 0; ind < ChaChaInputBytes(vec); ind++) {
+    if (!(ind % chachaBlockBytes)) {
+      keyStream = ChaCha20Block(key, nonce, vec.counter + uint32_t(ind / chachaBlockBytes));
+    }
+    if ((ChaChaInputByte(vec, ind) ^ keyStream[ind % chachaBlockBytes]) != HexByte(vec.cipherHex, ind)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Index of the first failing vector, the table size when all of them pass
+constexpr std::size_t FirstFailingSha256Vector() {
+  for (std::size_t ind = 0; ind < numSha256Vectors; ind++) {
+    if (!CheckSha256Vector(sha256Vectors[ind])) {
+      return ind;
+    }
+  }
+  return numSha256Vectors;
+}
+
+constexpr std::size_t FirstFailingChaChaVector() {
+  for (std::size_t ind = 0; ind < numChaChaVectors; ind++) {
+    if (!CheckChaChaVector(chachaVectors[ind])) {
+      return ind;
+    }
+  }
+  return numChaChaVectors;
+}
+
+static_assert(FirstFailingSha256Vector() == numSha256Vectors, "SHA256 vector from Sha256Regression.txt");
+static_assert(FirstFailingChaChaVector() == numChaChaVectors, "ChaCha20 vector from ChaCha20Regression.txt");
+
+template <std::size_t... Index>
+constexpr std::array<Sha256Digest, sizeof...(Index)> Sha256Digests(std::index_sequence<Index...>) {
+  return {Sha256(sha256Vectors[Index].input)...};
+}
+
+// Constant folded digests of every vector for the runtime comparison
+constexpr std::array<Sha256Digest, numSha256Vectors> sha256Digests =
+  Sha256Digests(std::make_index_sequence<numSha256Vectors>());
+
+// Runtime half: the C implementation must produce the compile time values
+int main(void) {
+  unsigned char output[SHA256_OUTPUT_BYTES], *input, *cipher;
+  ChaChaKey key = {};
+  ChaChaNonce nonce = {};
+  int totalFailures = 0, totalTests = 0;
+
+  fprintf(stderr, "--- Constexpr Regression Test ---\n");
+  for (std::size_t ind = 0; ind < numSha256Vectors; ind++, totalTests++) {
+    ErikSha256((unsigned char *)sha256Vectors[ind].input.data(), sha256Vectors[ind].input.size() * 8, output);
+    if (memcmp(output, sha256Digests[ind].data(), SHA256_OUTPUT_BYTES)) {
+      fprintf(stderr, "- SHA256 vector %zu FAILED\n", ind);
+      totalFailures++;
+    }
+  }
+
+  // static_assert pinned each ciphertext to the constexpr keystream
+  for (std::size_t ind = 0; ind < numChaChaVectors; ind++, totalTests++) {
+    const ChaCha20Vector &vec = chachaVectors[ind];
+    std::size_t inLen = ChaChaInputBytes(vec);
+
+    input = (unsigned char *)calloc(inLen + 1, sizeof(unsigned char));
+    cipher = (unsigned char *)calloc(inLen + 1, sizeof(unsigned char));
+    if (!input || !cipher) {
+      fprintf(stderr, "ERROR - Constexpr Regression: failed to allocate memory for ChaCha20 vector %zu.\n", ind);
+      free(input);
+      free(cipher);
+      return 1;
+    }
+    for (std::size_t inner = 0; inner < inLen; inner++) {
+      input[inner] = ChaChaInputByte(vec, inner);
+    }
+    key = ArrayFromHex<chachaKeyBytes>(vec.keyHex);
+    nonce = ArrayFromHex<chachaNonceBytes>(vec.nonceHex);
+    ErikChaCha20Encrypt(input, inLen, key.data(), nonce.data(), vec.counter, cipher);
+    for (std::size_t inner = 0; inner < inLen; inner++) {
+      if (cipher[inner] != HexByte(vec.cipherHex, inner)) {
+        fprintf(stderr, "- ChaCha20 vector %zu FAILED\n", ind);
+        totalFailures++;
+        break;
+      }
+    }
+    free(input);
+    free(cipher);
+  }
+
+  fprintf(stderr, "--- Total Tests: %d ---\n", totalTests);
+  fprintf(stderr, "--- Total Successes: %d ---\n", totalTests - totalFailures);
+  fprintf(stderr, "--- Total Failures: %d ---\n", totalFailures);
+
+  return totalFailures ? 1 : 0;
+}
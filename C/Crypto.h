@@ -1,9 +1,139 @@
 #ifndef __CRYPTO__
 #define __CRYPTO__
 
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Instrumentation: build with -DCRYPTO_STATS=1 (make STATS=1) to keep per
+// thread counters and latency histograms and to emit USDT probes. With the
+// default of 0 every hook below expands to nothing.
+#ifndef CRYPTO_STATS
+#define CRYPTO_STATS 0
+#endif
+
+enum cryptoStatCounter {
+  STAT_SHA256_CALLS = 0,
+  STAT_SHA256_BYTES,
+  STAT_SHA256_BLOCKS,
+  STAT_SHA256_BLOCKS_LANES,
+  STAT_SHA2_CALLS,
+  STAT_SHA2_BYTES,
+  STAT_SHA512_BLOCKS,
+  STAT_CHACHA20_CALLS,
+  STAT_CHACHA20_BYTES,
+  STAT_CHACHA20_BLOCKS_SINGLE,
+  STAT_CHACHA20_BLOCKS_PORTABLE,
+  STAT_CHACHA20_BLOCKS_AVX2,
+  STAT_CHACHA20_BLOCKS_AVX512,
+  STAT_RNG_CALLS,
+  STAT_RNG_BYTES,
+  STAT_RNG_REFILLS,
+  STAT_NUM_COUNTERS,
+};
+
+// Operations with latency histograms, also the id passed to the USDT probes
+enum cryptoStatOp {
+  STAT_OP_SHA256 = 0,
+  STAT_OP_SHA2,
+  STAT_OP_CHACHA20,
+  STAT_NUM_OPS,
+};
+
+// Message sizes are bucketed <64B, then one bucket per factor of 4 up to >=256KB.
+// Latencies are bucketed by power of two nanoseconds.
+#define STAT_SIZE_CLASSES         8
+#define STAT_LATENCY_BUCKETS      32
+
+#define ERR_STATS_DISABLED        -13
+
+struct cryptoStatsSnapshot {
+  uint64_t counters[STAT_NUM_COUNTERS];
+  uint64_t latency[STAT_NUM_OPS][STAT_SIZE_CLASSES][STAT_LATENCY_BUCKETS];
+};
+
+int CryptoStatsSnapshot(struct cryptoStatsSnapshot *snap);
+void CryptoStatsPrint(FILE *out, struct cryptoStatsSnapshot *snap);
+
+#if CRYPTO_STATS
+#include <time.h>
+
+struct cryptoThreadStats {
+  struct cryptoStatsSnapshot stats;
+  struct cryptoThreadStats *next, *prev;
+};
+
+extern __thread struct cryptoThreadStats *cryptoStatsLocal;
+struct cryptoThreadStats *CryptoStatsRegister(void);
+
+// Only the owning thread writes its counters, relaxed atomics keep the
+// snapshot reader race free without a locked instruction on the hot path
+static inline void CryptoStatBump(uint64_t *slot, uint64_t val) {
+  __atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) + val, __ATOMIC_RELAXED);
+}
+
+static inline void CryptoStatAdd(enum cryptoStatCounter counter, uint64_t val) {
+  struct cryptoThreadStats *local = cryptoStatsLocal;
+
+  if (local || (local = CryptoStatsRegister())) {
+    CryptoStatBump(&local->stats.counters[counter], val);
+  }
+}
+
+static inline uint64_t CryptoStatNow(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+static inline void CryptoStatLatency(enum cryptoStatOp op, uint64_t len, uint64_t nanos) {
+  struct cryptoThreadStats *local = cryptoStatsLocal;
+  unsigned int sizeClass = 0, bucket = 63 - __builtin_clzll(nanos | 1);
+
+  if (len >= 64) {
+    sizeClass = ((63 - __builtin_clzll(len)) - 6) / 2 + 1;
+  }
+  if (sizeClass >= STAT_SIZE_CLASSES) {
+    sizeClass = STAT_SIZE_CLASSES - 1;
+  }
+  if (bucket >= STAT_LATENCY_BUCKETS) {
+    bucket = STAT_LATENCY_BUCKETS - 1;
+  }
+  if (local || (local = CryptoStatsRegister())) {
+    CryptoStatBump(&local->stats.latency[op][sizeClass][bucket], 1);
+  }
+}
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CRYPTO_TRACE(probe, op, len)    DTRACE_PROBE2(crypto, probe, op, len)
+#endif
+#endif
+#ifndef CRYPTO_TRACE
+#define CRYPTO_TRACE(probe, op, len)    do { } while (0)
+#endif
+
+#define CRYPTO_STAT_ADD(counter, val)   CryptoStatAdd(counter, val)
+#define CRYPTO_STAT_BEGIN(op, len)      CRYPTO_TRACE(op_entry, op, len); uint64_t cryptoStatStart = CryptoStatNow()
+#define CRYPTO_STAT_END(op, len)        CryptoStatLatency(op, len, CryptoStatNow() - cryptoStatStart); CRYPTO_TRACE(op_exit, op, len)
+#else
+#define CRYPTO_STAT_ADD(counter, val)   do { } while (0)
+#define CRYPTO_STAT_BEGIN(op, len)      do { } while (0)
+#define CRYPTO_STAT_END(op, len)        do { } while (0)
+#endif
+
 enum algorithm {
   SHA256 = 1,
   CHACHA20,
+  SHA224,
+  SHA384,
+  SHA512,
+  SHA512_256,
 };
 
 // SHA256
@@ -28,6 +158,24 @@ enum algorithm {
 #define ERR_SHA256_COMPRESS       -4
 #define ERR_SHA256_BIGENDCONV     -5
 #define ERR_SHA256_MAIN           -6
+#define ERR_SHA256_STREAM         -8
+#define ERR_SHA256_MIDSTATE       -9
+
+// Chaining state after a whole number of compressed blocks
+struct sha256Midstate {
+  unsigned int hash[8];
+  unsigned long numBlocks;
+};
+
+// Streaming context: midstate plus the not yet compressed tail of the input
+struct sha256Ctx {
+  struct sha256Midstate mid;
+  unsigned char block[SHA256_BLOCK_SIZE_BYTES];
+  unsigned int blockLen;
+};
+
+// LRU cache of prefix midstates, not thread safe
+struct sha256PrefixCache;
 
 int ErikSha256(unsigned char *inBuff, unsigned long inLenBits, unsigned char *outBuff);
 void CompressFuncSha256(unsigned int workingVars[8], unsigned int messageSchedule[64]);
@@ -38,6 +186,106 @@ unsigned int CalcNumPadZeroesSha256(unsigned long currLen);
 void DumpHexString(unsigned char *input, unsigned long inLenBits);
 void DumpHexStringBytes(unsigned char *input, unsigned long inLenBits);
 int EndiannessConvertWordSha256(unsigned char *buff, unsigned long numBits);
+void CompressBlockSha256(unsigned int hash[8], unsigned char *block);
+void Sha256Init(struct sha256Ctx *ctx);
+int Sha256Update(struct sha256Ctx *ctx, unsigned char *input, unsigned long inLen);
+int Sha256Final(struct sha256Ctx *ctx, unsigned char *outBuff);
+int Sha256ExportMidstate(struct sha256Ctx *ctx, struct sha256Midstate *mid);
+int Sha256ImportMidstate(struct sha256Ctx *ctx, struct sha256Midstate *mid);
+struct sha256PrefixCache *Sha256PrefixCacheCreate(unsigned int numEntries);
+void Sha256PrefixCacheDestroy(struct sha256PrefixCache *cache);
+int ErikSha256Prefixed(struct sha256PrefixCache *cache, unsigned char *prefix, unsigned long prefixLen,
+                       unsigned char *suffix, unsigned long suffixLen, unsigned char *outBuff);
+int ErikSha256PrefixedKey(struct sha256PrefixCache *cache, unsigned long prefixKey, unsigned char *prefix, unsigned long prefixLen,
+                          unsigned char *suffix, unsigned long suffixLen, unsigned char *outBuff);
+
+// Number of messages compressed side by side by the multi-buffer sha256 path
+#if defined(__AVX512F__)
+#define SHA256_LANES              16
+#elif defined(__AVX2__)
+#define SHA256_LANES              8
+#else
+#define SHA256_LANES              4
+#endif
+
+int Sha256MultiBuffer(unsigned char **inputs, unsigned long *inLens, unsigned int count, unsigned char **outputs);
+
+// SHA224 (SHA256 core with its own initial hash values, truncated output)
+#define SHA224_OUTPUT_BITS        224
+#define SHA224_OUTPUT_BYTES       (SHA224_OUTPUT_BITS / 8)
+
+void Sha224Init(struct sha256Ctx *ctx);
+
+// SHA512 family
+#define SHA512_OUTPUT_BITS        512
+#define SHA512_OUTPUT_BYTES       (SHA512_OUTPUT_BITS / 8)
+#define SHA384_OUTPUT_BITS        384
+#define SHA384_OUTPUT_BYTES       (SHA384_OUTPUT_BITS / 8)
+#define SHA512_256_OUTPUT_BITS    256
+#define SHA512_256_OUTPUT_BYTES   (SHA512_256_OUTPUT_BITS / 8)
+#define SHA512_BLOCK_SIZE_BITS    1024
+#define SHA512_BLOCK_SIZE_BYTES   (SHA512_BLOCK_SIZE_BITS / 8)
+#define SHA512_PAD_ZEROES_VAL     896
+#define SHA512_ROUNDS             80
+
+#define SHA512_RR(val, shift)     ((val >> shift) | (val << (64 - shift)))
+#define SHA512_SR(val, shift)     (val >> shift)
+#define SHA512_CH_FUNC(e, f, g)   ((e & f) ^ ((~e) & g))
+#define SHA512_MAJ_FUNC(a, b, c)  ((a & b) ^ (a & c) ^ (b & c))
+#define SHA512_BSIGMA0_FUNC(x)    ((SHA512_RR(x, 28)) ^ (SHA512_RR(x, 34)) ^ (SHA512_RR(x, 39)))
+#define SHA512_BSIGMA1_FUNC(x)    ((SHA512_RR(x, 14)) ^ (SHA512_RR(x, 18)) ^ (SHA512_RR(x, 41)))
+#define SHA512_LSIGMA0_FUNC(x)    ((SHA512_RR(x, 1)) ^ (SHA512_RR(x, 8)) ^ (SHA512_SR(x, 7)))
+#define SHA512_LSIGMA1_FUNC(x)    ((SHA512_RR(x, 19)) ^ (SHA512_RR(x, 61)) ^ (SHA512_SR(x, 6)))
+
+#define ERR_SHA512_STREAM         -10
+#define ERR_SHA2_ALGORITHM        -11
+
+struct sha512Ctx {
+  uint64_t hash[8];
+  unsigned long numBlocks;
+  unsigned char block[SHA512_BLOCK_SIZE_BYTES];
+  unsigned int blockLen;
+};
+
+void CompressBlocksSha512(uint64_t hash[8], unsigned char *blocks, unsigned long numBlocks);
+int Sha512Init(struct sha512Ctx *ctx, enum algorithm alg);
+int Sha512Update(struct sha512Ctx *ctx, unsigned char *input, unsigned long inLen);
+int Sha512Final(struct sha512Ctx *ctx, unsigned char *outBuff);
+
+// SHA2 family: one streaming API over every SHA2 variant
+#define SHA2_MAX_OUTPUT_BYTES     SHA512_OUTPUT_BYTES
+
+// Block buffering and padding shared by the SHA256 and SHA512 contexts.
+// lenBytes is the size of the bit length field, 8 for SHA256, 16 for SHA512.
+struct sha2Core {
+  unsigned int blockBytes;
+  unsigned int lenBytes;
+  void (*compress)(void *hash, unsigned char *blocks, unsigned long numBlocks);
+};
+
+void Sha2CoreUpdate(const struct sha2Core *core, void *hash, unsigned long *numBlocks, unsigned char *block,
+                    unsigned int *blockLen, unsigned char *input, unsigned long inLen);
+void Sha2CoreFinal(const struct sha2Core *core, void *hash, unsigned long numBlocks, unsigned char *block, unsigned int blockLen);
+
+struct sha2Ctx {
+  enum algorithm alg;
+  union {
+    struct sha256Ctx ctx256;
+    struct sha512Ctx ctx512;
+  } u;
+};
+
+unsigned int Sha2OutputBytes(enum algorithm alg);
+int Sha2Init(struct sha2Ctx *ctx, enum algorithm alg);
+int Sha2Update(struct sha2Ctx *ctx, unsigned char *input, unsigned long inLen);
+int Sha2Final(struct sha2Ctx *ctx, unsigned char *outBuff);
+int ErikSha2(enum algorithm alg, unsigned char *inBuff, unsigned long inLen, unsigned char *outBuff);
+
+// Manifest verification
+#define MANIFEST_CHUNK_BYTES      (1 << 20)
+#define ERR_MANIFEST              -12
+
+int ErikVerifyManifest(FILE *manifestFile, unsigned int numReaders, unsigned int numWorkers, unsigned long maxInflightBytes);
 
 // ChaCha20
 #define CHACHA_KEY_SIZE_BITS      256
@@ -45,13 +293,164 @@ int EndiannessConvertWordSha256(unsigned char *buff, unsigned long numBits);
 #define CHACHA_NONCE_SIZE_BITS    96
 #define CHACHA_NONCE_SIZE_BYTES   (CHACHA_NONCE_SIZE_BITS / 8)
 #define CHACHA_STATE_SIZE         16
+#define CHACHA_BLOCK_SIZE_BYTES   64
+
+// Most blocks computed side by side by a multi-block keystream kernel. The
+// kernel is picked at runtime, so this does not depend on the -m flags.
+#define CHACHA_LANES              16
+
+// Keystream backends, CHACHA_BACKEND_BEST picks the widest one the CPU supports
+#define CHACHA_BACKEND_BEST       0
+#define CHACHA_BACKEND_PORTABLE   1
+#define CHACHA_BACKEND_AVX2       2
+#define CHACHA_BACKEND_AVX512     3
 
 #define ERR_CHACHA_MAIN           -2
+#define ERR_CHACHA_RNG            -7
 
+// Precomputed state for one key and nonce, exactly one cache line. Word 12 is
+// the block counter, the only word the block functions set per block.
+struct chacha20Key {
+  uint32_t state[CHACHA_STATE_SIZE];
+} __attribute__((aligned(64)));
+
+void ChaCha20KeyInit(struct chacha20Key *chachaKey, unsigned char *key, unsigned char *nonce);
+void ChaCha20KeyWipe(struct chacha20Key *chachaKey);
+void ChaCha20KeyBlock(const struct chacha20Key *chachaKey, uint32_t blockCount, unsigned char *output);
+void ChaCha20KeyBlocks(const struct chacha20Key *chachaKey, uint32_t blockCount, unsigned int numBlocks, unsigned char *output);
+int ChaCha20KeyBlocksBackend(const struct chacha20Key *chachaKey, uint32_t blockCount, unsigned int numBlocks, unsigned char *output, int backend);
+unsigned int ChaCha20BackendLanes(int backend);
+void ChaCha20BlocksGather(const struct chacha20Key **keys, uint32_t *blockCounts, unsigned int numBlocks, unsigned char **outputs);
+int ChaCha20KeyEncrypt(const struct chacha20Key *chachaKey, unsigned char *input, unsigned long inLen, uint32_t counter, unsigned char *output);
 void ChaCha20Block(unsigned char *key, unsigned char *nonce, uint32_t blockCount, unsigned char *output);
+void ChaCha20Blocks(unsigned char *key, unsigned char *nonce, uint32_t blockCount, unsigned int numBlocks, unsigned char *output);
 void ChaChaInitBlockState(uint32_t *state, unsigned char *key, unsigned char *nonce, uint32_t blockCount);
 void ChaChaQuartRound(uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d);
 void PrintChaCha20State(uint32_t *state);
 int ErikChaCha20Encrypt(unsigned char *input, unsigned int inLen, unsigned char *key, unsigned char *nonce, uint32_t counter, unsigned char *output);
 
-#endif
\ No newline at end of file
+// Poly1305 and ChaCha20-Poly1305 AEAD
+#define POLY1305_KEY_SIZE_BYTES   32
+#define POLY1305_TAG_SIZE_BYTES   16
+#define POLY1305_BLOCK_SIZE_BYTES 16
+
+#define ERR_POLY1305_MAIN         -14
+#define ERR_POLY1305_AUTH         -18
+
+int ErikGenPoly1305(unsigned char *input, unsigned long inLen, unsigned char *key, unsigned char *tag);
+void PolyClamp(unsigned char *r);
+int ChaCha20Poly1305Seal(unsigned char *input, unsigned long inLen, unsigned char *aad, unsigned long aadLen,
+                         unsigned char *polyKey, unsigned char *keyStream, unsigned char *output, unsigned char *tag);
+int ChaCha20Poly1305Open(unsigned char *input, unsigned long inLen, unsigned char *aad, unsigned long aadLen,
+                         unsigned char *polyKey, unsigned char *keyStream, unsigned char *output, unsigned char *tag);
+int ChaCha20Poly1305KeyEncrypt(const struct chacha20Key *chachaKey, unsigned char *input, unsigned long inLen,
+                               unsigned char *aad, unsigned long aadLen, unsigned char *output, unsigned char *tag);
+int ChaCha20Poly1305KeyDecrypt(const struct chacha20Key *chachaKey, unsigned char *input, unsigned long inLen,
+                               unsigned char *aad, unsigned long aadLen, unsigned char *output, unsigned char *tag);
+int ErikChaCha20Poly1305Encrypt(unsigned char *input, unsigned long inLen, unsigned char *aad, unsigned long aadLen,
+                                unsigned char *key, unsigned char *nonce, unsigned char *output, unsigned char *tag);
+int ErikChaCha20Poly1305Decrypt(unsigned char *input, unsigned long inLen, unsigned char *aad, unsigned long aadLen,
+                                unsigned char *key, unsigned char *nonce, unsigned char *output, unsigned char *tag);
+
+// ChaCha20 CSPRNG
+int ErikChaChaRngBytes(unsigned char *output, unsigned long outLen);
+
+// Content defined chunking with a gear rolling hash, fused with sha256
+#define CDC_WINDOW_BYTES          64
+#define CDC_DEFAULT_MIN_BYTES     2048
+#define CDC_DEFAULT_AVG_BYTES     8192
+#define CDC_DEFAULT_MAX_BYTES     65536
+
+#define ERR_CDC                   -17
+
+struct cdcChunk {
+  unsigned long offset;
+  unsigned long len;
+  unsigned char digest[SHA256_OUTPUT_BYTES];
+};
+
+struct cdcChunker {
+  unsigned long minSize, avgSize, maxSize;
+  uint64_t maskS, maskL, hash;
+  unsigned long chunkLen, offset;
+  struct sha256Ctx ctx;
+};
+
+// Streaming ingestion (CdcUpdate/CdcFinal) runs on the calling thread only, a
+// chunk's start depends on every byte before it. Only ErikCdcChunkBuffer, which
+// sees the whole buffer up front, splits the work across threads.
+int CdcInit(struct cdcChunker *chunker, unsigned long minSize, unsigned long avgSize, unsigned long maxSize);
+int CdcUpdate(struct cdcChunker *chunker, unsigned char *input, unsigned long inLen,
+              void (*emit)(struct cdcChunk *chunk, void *arg), void *arg);
+int CdcFinal(struct cdcChunker *chunker, void (*emit)(struct cdcChunk *chunk, void *arg), void *arg);
+int ErikCdcChunkBuffer(unsigned char *input, unsigned long inLen, unsigned long minSize, unsigned long avgSize,
+                       unsigned long maxSize, unsigned int numThreads, struct cdcChunk **chunks, unsigned long *numChunks);
+
+// Async crypto job engine, completions are signaled on an eventfd
+enum cryptoJobType {
+  JOB_HASH = 1,
+  JOB_ENCRYPT,
+  JOB_AEAD,
+  JOB_AEAD_OPEN,
+};
+
+// Jobs up to this many bytes are coalesced into multi-buffer batches
+#define CRYPTO_JOB_SMALL_BYTES    4096
+#define CRYPTO_JOB_MAX_BATCH      64
+
+#define ERR_JOB_QUEUE_FULL        -15
+#define ERR_JOB_ENGINE            -16
+
+// Job flags, any other bit is rejected by CryptoJobSubmit
+#define CRYPTO_JOB_KEY_OBJECT     0x1
+
+// Caller owned job, it must stay valid until its callback has run.
+// JOB_HASH writes a sha256 digest to output, JOB_ENCRYPT uses counter and
+// JOB_AEAD writes the RFC 8439 ciphertext to output and tag to tag.
+// JOB_AEAD_OPEN checks the ciphertext in input against tag and only then writes
+// the plaintext to output, result is ERR_POLY1305_AUTH on a mismatch. Encrypt
+// and AEAD jobs take key and nonce, or the precomputed chachaKey when flags
+// has CRYPTO_JOB_KEY_OBJECT. flags and chachaKey come last so jobs filled in
+// field by field before they existed only need flags set to 0.
+struct cryptoJob {
+  enum cryptoJobType type;
+  unsigned char *input;
+  unsigned long inLen;
+  unsigned char *aad;
+  unsigned long aadLen;
+  unsigned char *key;
+  unsigned char *nonce;
+  uint32_t counter;
+  unsigned char *output;
+  unsigned char *tag;
+  int result;
+  void (*callback)(struct cryptoJob *job, void *arg);
+  void *callbackArg;
+  uint64_t submitNs, startNs, doneNs;
+  struct cryptoJob *next;
+  unsigned int flags;
+  const struct chacha20Key *chachaKey;
+};
+
+struct cryptoJobStats {
+  uint64_t submitted, completed, rejected;
+  uint64_t batches, batchedJobs;          // worker batches of small jobs and the jobs in them
+  uint64_t laneSlotsUsed, laneSlotsTotal; // SIMD lane blocks doing real work vs computed
+  uint64_t queueNsTotal, queueNsMax;      // submit to worker pickup
+  unsigned long inflightJobs, inflightBytes;
+};
+
+struct cryptoJobEngine;
+
+struct cryptoJobEngine *CryptoJobEngineCreate(unsigned int numWorkers, unsigned long maxInflightJobs, unsigned long maxInflightBytes);
+int CryptoJobEngineEventFd(struct cryptoJobEngine *engine);
+int CryptoJobSubmit(struct cryptoJobEngine *engine, struct cryptoJob *job);
+int CryptoJobReap(struct cryptoJobEngine *engine);
+void CryptoJobEngineStats(struct cryptoJobEngine *engine, struct cryptoJobStats *stats);
+void CryptoJobEngineDestroy(struct cryptoJobEngine *engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
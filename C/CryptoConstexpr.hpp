@@ -0,0 +1,227 @@
+/* Description: Header only C++17 constexpr SHA256 and ChaCha20
+ *
+ * Compile time versions of the C code in sha256.c and ChaChaPoly.c for
+ * digests of static data and fixed keystreams. They follow the same FIPS
+ * 180-2 / RFC 8439 steps as CompressFuncSha256 and ChaCha20Block, but on
+ * std::array values so every function can run inside a constant expression.
+ * ConstexprCheck.cpp pins them to the regression vectors with static_assert.
+ */
+
+#ifndef __CRYPTO_CONSTEXPR__
+#define __CRYPTO_CONSTEXPR__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace CryptoConstexpr {
+
+constexpr std::size_t sha256OutputBytes = 32;
+constexpr std::size_t sha256BlockBytes = 64;
+constexpr std::size_t chachaKeyBytes = 32;
+constexpr std::size_t chachaNonceBytes = 12;
+constexpr std::size_t chachaBlockBytes = 64;
+
+using Sha256Digest = std::array<uint8_t, sha256OutputBytes>;
+using ChaChaKey = std::array<uint8_t, chachaKeyBytes>;
+using ChaChaNonce = std::array<uint8_t, chachaNonceBytes>;
+using ChaChaBlock = std::array<uint8_t, chachaBlockBytes>;
+
+// Sha256 initial hash values
+constexpr std::array<uint32_t, 8> initHashSha256 = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// Sha256 constants needed for functionality
+constexpr std::array<uint32_t, 64> constantWordsSha256 = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+constexpr uint32_t Rotr32(uint32_t val, unsigned int shift) {
+  return (val >> shift) | (val << (32 - shift));
+}
+
+constexpr uint32_t Rotl32(uint32_t val, unsigned int shift) {
+  return (val << shift) | (val >> (32 - shift));
+}
+
+// Function to compress one big-endian 64B block into the chaining state
+constexpr void CompressBlockSha256(std::array<uint32_t, 8> &hash, const uint8_t *block) {
+  std::array<uint32_t, 64> schedule = {};
+  std::array<uint32_t, 8> work = hash;
+  uint32_t T1 = 0, T2 = 0;
+
+  for (std::size_t index = 0; index < 16; index++) {
+    schedule[index] = (uint32_t(block[4*index]) << 24) | (uint32_t(block[(4*index)+1]) << 16)
+                      | (uint32_t(block[(4*index)+2]) << 8) | uint32_t(block[(4*index)+3]);
+  }
+  for (std::size_t index = 16; index < 64; index++) {
+    uint32_t s0 = Rotr32(schedule[index-15], 7) ^ Rotr32(schedule[index-15], 18) ^ (schedule[index-15] >> 3);
+    uint32_t s1 = Rotr32(schedule[index-2], 17) ^ Rotr32(schedule[index-2], 19) ^ (schedule[index-2] >> 10);
+    schedule[index] = s1 + schedule[index-7] + s0 + schedule[index-16];
+  }
+  for (std::size_t index = 0; index < 64; index++) {
+    T1 = work[7] + (Rotr32(work[4], 6) ^ Rotr32(work[4], 11) ^ Rotr32(work[4], 25))
+         + ((work[4] & work[5]) ^ ((~work[4]) & work[6])) + constantWordsSha256[index] + schedule[index];
+    T2 = (Rotr32(work[0], 2) ^ Rotr32(work[0], 13) ^ Rotr32(work[0], 22))
+         + ((work[0] & work[1]) ^ (work[0] & work[2]) ^ (work[1] & work[2]));
+    work[7] = work[6];
+    work[6] = work[5];
+    work[5] = work[4];
+    work[4] = work[3] + T1;
+    work[3] = work[2];
+    work[2] = work[1];
+    work[1] = work[0];
+    work[0] = T1 + T2;
+  }
+  for (std::size_t index = 0; index < 8; index++) {
+    hash[index] += work[index];
+  }
+}
+
+// Sha256 of a byte string, e.g. Sha256("abc")
+constexpr Sha256Digest Sha256(std::string_view input) {
+  std::array<uint32_t, 8> hash = initHashSha256;
+  std::array<uint8_t, sha256BlockBytes> block = {};
+  uint64_t lenBits = uint64_t(input.size()) * 8;
+  std::size_t index = 0, blockLen = 0;
+  Sha256Digest digest = {};
+
+  for (; (index + sha256BlockBytes) <= input.size(); index += sha256BlockBytes) {
+    for (std::size_t inner = 0; inner < sha256BlockBytes; inner++) {
+      block[inner] = uint8_t(input[index+inner]);
+    }
+    CompressBlockSha256(hash, block.data());
+  }
+  for (; index < input.size(); index++) {
+    block[blockLen++] = uint8_t(input[index]);
+  }
+  // Padding: one bit, zeroes up to 56 bytes mod 64, then the 64b bit length
+  block[blockLen++] = 0x80;
+  if (blockLen > 56) {
+    for (; blockLen < sha256BlockBytes; blockLen++) {
+      block[blockLen] = 0;
+    }
+    CompressBlockSha256(hash, block.data());
+    blockLen = 0;
+  }
+  for (; blockLen < 56; blockLen++) {
+    block[blockLen] = 0;
+  }
+  for (std::size_t inner = 0; inner < 8; inner++) {
+    block[56+inner] = uint8_t(lenBits >> (56 - (8*inner)));
+  }
+  CompressBlockSha256(hash, block.data());
+
+  for (std::size_t inner = 0; inner < sha256OutputBytes; inner++) {
+    digest[inner] = uint8_t(hash[inner/4] >> (24 - (8*(inner % 4))));
+  }
+  return digest;
+}
+
+// Quarter round on four words of a ChaCha20 state
+constexpr void ChaChaQuartRound(std::array<uint32_t, 16> &state, int a, int b, int c, int d) {
+  state[a] += state[b]; state[d] ^= state[a]; state[d] = Rotl32(state[d], 16);
+  state[c] += state[d]; state[b] ^= state[c]; state[b] = Rotl32(state[b], 12);
+  state[a] += state[b]; state[d] ^= state[a]; state[d] = Rotl32(state[d], 8);
+  state[c] += state[d]; state[b] ^= state[c]; state[b] = Rotl32(state[b], 7);
+}
+
+// ChaCha20 block function, the keystream block for one block counter
+constexpr ChaChaBlock ChaCha20Block(const ChaChaKey &key, const ChaChaNonce &nonce, uint32_t blockCount) {
+  std::array<uint32_t, 16> init = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+  std::array<uint32_t, 16> state = {};
+  ChaChaBlock output = {};
+
+  for (std::size_t ind = 0; ind < 8; ind++) {
+    init[4+ind] = uint32_t(key[4*ind]) | (uint32_t(key[(4*ind)+1]) << 8)
+                  | (uint32_t(key[(4*ind)+2]) << 16) | (uint32_t(key[(4*ind)+3]) << 24);
+  }
+  init[12] = blockCount;
+  for (std::size_t ind = 0; ind < 3; ind++) {
+    init[13+ind] = uint32_t(nonce[4*ind]) | (uint32_t(nonce[(4*ind)+1]) << 8)
+                   | (uint32_t(nonce[(4*ind)+2]) << 16) | (uint32_t(nonce[(4*ind)+3]) << 24);
+  }
+  state = init;
+  for (int ind = 0; ind < 10; ind++) {
+    // Column Rounds
+    ChaChaQuartRound(state, 0, 4, 8, 12);
+    ChaChaQuartRound(state, 1, 5, 9, 13);
+    ChaChaQuartRound(state, 2, 6, 10, 14);
+    ChaChaQuartRound(state, 3, 7, 11, 15);
+    // Diagonal Rounds
+    ChaChaQuartRound(state, 0, 5, 10, 15);
+    ChaChaQuartRound(state, 1, 6, 11, 12);
+    ChaChaQuartRound(state, 2, 7, 8, 13);
+    ChaChaQuartRound(state, 3, 4, 9, 14);
+  }
+  for (std::size_t ind = 0; ind < 16; ind++) {
+    uint32_t word = state[ind] + init[ind];
+    for (std::size_t inner = 0; inner < 4; inner++) {
+      output[(4*ind)+inner] = uint8_t(word >> (8*inner));
+    }
+  }
+  return output;
+}
+
+// ChaCha20 encryption of a fixed size buffer, same as ErikChaCha20Encrypt
+template <std::size_t N>
+constexpr std::array<uint8_t, N> ChaCha20Encrypt(const std::array<uint8_t, N> &input, const ChaChaKey &key,
+                                                 const ChaChaNonce &nonce, uint32_t counter) {
+  std::array<uint8_t, N> output = {};
+  ChaChaBlock keyStream = {};
+
+  for (std::size_t ind = 0; ind < N; ind++) {
+    if (!(ind % chachaBlockBytes)) {
+      keyStream = ChaCha20Block(key, nonce, counter + uint32_t(ind / chachaBlockBytes));
+    }
+    output[ind] = input[ind] ^ keyStream[ind % chachaBlockBytes];
+  }
+  return output;
+}
+
+// Function to turn a hex string literal into bytes, e.g. FromHex("00ff")
+template <std::size_t N>
+constexpr std::array<uint8_t, (N - 1) / 2> FromHex(const char (&hex)[N]) {
+  static_assert(((N - 1) % 2) == 0, "hex string must have an even number of digits");
+  std::array<uint8_t, (N - 1) / 2> output = {};
+
+  for (std::size_t ind = 0; ind < (N - 1); ind++) {
+    char digit = hex[ind];
+    uint8_t nibble = (digit >= 'a') ? (digit - 'a' + 10) : ((digit >= 'A') ? (digit - 'A' + 10) : (digit - '0'));
+    output[ind/2] |= uint8_t(nibble << ((ind % 2) ? 0 : 4));
+  }
+  return output;
+}
+
+// Function to turn a string literal into bytes without its terminator
+template <std::size_t N>
+constexpr std::array<uint8_t, N - 1> Bytes(const char (&str)[N]) {
+  std::array<uint8_t, N - 1> output = {};
+
+  for (std::size_t ind = 0; ind < (N - 1); ind++) {
+    output[ind] = uint8_t(str[ind]);
+  }
+  return output;
+}
+
+// std::array comparison is only constexpr from C++20 on
+template <std::size_t N>
+constexpr bool Equal(const std::array<uint8_t, N> &a, const std::array<uint8_t, N> &b) {
+  for (std::size_t ind = 0; ind < N; ind++) {
+    if (a[ind] != b[ind]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace CryptoConstexpr
+
+#endif
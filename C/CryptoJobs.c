@@ -0,0 +1,460 @@
+/* Description: Asynchronous crypto job engine for event loop servers
+ *
+ * Callers submit caller owned job structs without blocking. A pool of worker
+ * threads takes everything queued, up to CRYPTO_JOB_MAX_BATCH jobs, in one
+ * pickup. Small hash jobs of a pickup are hashed together by the multi-buffer
+ * sha256 path, and the keystream of small encrypt, AEAD seal and AEAD open
+ * jobs is generated together by the gathered multi-block ChaCha20 kernel, so
+ * a busy queue turns into full SIMD lanes. Large jobs run on their own after
+ * the small jobs of the same pickup have been posted.
+ *
+ * Finished jobs go on a done list and the engine's eventfd is signaled. The
+ * event loop polls the eventfd and calls CryptoJobReap, which runs the
+ * callbacks on the loop's own thread. The number and bytes of jobs in flight,
+ * submitted but not yet finished, are bounded and submit fails fast past them.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Crypto.h"
+
+// Keystream blocks a worker needs for one pickup of small encrypt and AEAD jobs
+#define CRYPTO_JOB_MAX_BLOCKS     (CRYPTO_JOB_MAX_BATCH * ((CRYPTO_JOB_SMALL_BYTES / CHACHA_BLOCK_SIZE_BYTES) + 2))
+
+struct cryptoJobWorker {
+  struct chacha20Key jobKeys[CRYPTO_JOB_MAX_BATCH];
+  struct cryptoJobEngine *engine;
+  pthread_t thread;
+  unsigned char *keyStream;
+  const struct chacha20Key *keys[CRYPTO_JOB_MAX_BLOCKS];
+  uint32_t counters[CRYPTO_JOB_MAX_BLOCKS];
+  unsigned char *outputs[CRYPTO_JOB_MAX_BLOCKS];
+};
+
+struct cryptoJobEngine {
+  struct cryptoJobWorker *workers;
+  unsigned int numWorkers, numStarted;
+  int eventFd, stopping;
+  unsigned long maxInflightJobs, maxInflightBytes;
+  struct cryptoJob *pendingHead, *pendingTail;
+  struct cryptoJob *doneHead, *doneTail;
+  struct cryptoJobStats stats;
+  pthread_mutex_t lock;
+  pthread_cond_t workReady;
+};
+
+// Function that returns a monotonic timestamp in nanoseconds
+static uint64_t CryptoJobNowNs(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec * 1000000000UL) + now.tv_nsec;
+}
+
+// Function to sort lengths shortest first, the order Sha256MultiBuffer groups lanes in
+static int CompareLenAsc(const void *a, const void *b) {
+  unsigned long lenA = *(const unsigned long *)a, lenB = *(const unsigned long *)b;
+
+  return (lenA > lenB) - (lenA < lenB);
+}
+
+// Function that returns the key object of a job, NULL when it carries key and nonce
+static const struct chacha20Key *CryptoJobKeyObject(const struct cryptoJob *job) {
+  return (job->flags & CRYPTO_JOB_KEY_OBJECT) ? job->chachaKey : NULL;
+}
+
+// Function to run the small hash jobs of a pickup through the multi-buffer path
+static void RunHashBatch(struct cryptoJobWorker *worker, struct cryptoJob **jobs, unsigned int count) {
+  unsigned char *inputs[CRYPTO_JOB_MAX_BATCH], *outputs[CRYPTO_JOB_MAX_BATCH];
+  unsigned long inLens[CRYPTO_JOB_MAX_BATCH], sorted[CRYPTO_JOB_MAX_BATCH];
+  unsigned long used = 0, total = 0;
+  unsigned int ind, last;
+  int ret;
+
+  for (ind = 0; ind < count; ind++) {
+    inputs[ind] = jobs[ind]->input;
+    inLens[ind] = sorted[ind] = jobs[ind]->inLen;
+    outputs[ind] = jobs[ind]->output;
+    used += (jobs[ind]->inLen + 9 + SHA256_BLOCK_SIZE_BYTES - 1) / SHA256_BLOCK_SIZE_BYTES;
+  }
+  ret = Sha256MultiBuffer(inputs, inLens, count, outputs);
+  for (ind = 0; ind < count; ind++) {
+    jobs[ind]->result = ret;
+  }
+  // Messages are hashed shortest first in groups of lanes, each group runs as long as its last one
+  qsort(sorted, count, sizeof(unsigned long), CompareLenAsc);
+  for (ind = 0; ind < count; ind += SHA256_LANES) {
+    last = ((ind + SHA256_LANES) < count) ? (ind + SHA256_LANES - 1) : (count - 1);
+    total += ((sorted[last] + 9 + SHA256_BLOCK_SIZE_BYTES - 1) / SHA256_BLOCK_SIZE_BYTES) * SHA256_LANES;
+  }
+  pthread_mutex_lock(&worker->engine->lock);
+  worker->engine->stats.laneSlotsUsed += used;
+  worker->engine->stats.laneSlotsTotal += total;
+  pthread_mutex_unlock(&worker->engine->lock);
+}
+
+// Function to run the small encrypt and AEAD jobs of a pickup off one gathered keystream
+static void RunStreamBatch(struct cryptoJobWorker *worker, struct cryptoJob **jobs, unsigned int count) {
+  unsigned int ind, block, numBlocks = 0, jobBlocks, first[CRYPTO_JOB_MAX_BATCH];
+  unsigned int lanes = ChaCha20BackendLanes(CHACHA_BACKEND_BEST);
+  unsigned long byte;
+  unsigned char *keyStream;
+  const struct chacha20Key *chachaKey;
+  struct cryptoJob *job;
+
+  for (ind = 0; ind < count; ind++) {
+    job = jobs[ind];
+    first[ind] = numBlocks;
+    // Jobs without a precomputed key object get one laid out once for all their blocks
+    chachaKey = CryptoJobKeyObject(job);
+    if (!chachaKey) {
+      ChaCha20KeyInit(&worker->jobKeys[ind], job->key, job->nonce);
+      chachaKey = &worker->jobKeys[ind];
+    }
+    jobBlocks = (job->inLen + CHACHA_BLOCK_SIZE_BYTES - 1) / CHACHA_BLOCK_SIZE_BYTES;
+    // AEAD takes its Poly1305 key from block 0 and encrypts from block 1
+    if (job->type != JOB_ENCRYPT) {
+      jobBlocks++;
+    }
+    for (block = 0; block < jobBlocks; block++) {
+      worker->keys[numBlocks] = chachaKey;
+      worker->counters[numBlocks] = ((job->type == JOB_ENCRYPT) ? job->counter : 0) + block;
+      worker->outputs[numBlocks] = worker->keyStream + (numBlocks * CHACHA_BLOCK_SIZE_BYTES);
+      numBlocks++;
+    }
+  }
+  ChaCha20BlocksGather(worker->keys, worker->counters, numBlocks, worker->outputs);
+
+  for (ind = 0; ind < count; ind++) {
+    job = jobs[ind];
+    keyStream = worker->keyStream + (first[ind] * CHACHA_BLOCK_SIZE_BYTES);
+    if (job->type == JOB_AEAD) {
+      job->result = ChaCha20Poly1305Seal(job->input, job->inLen, job->aad, job->aadLen, keyStream,
+                                         keyStream+CHACHA_BLOCK_SIZE_BYTES, job->output, job->tag);
+    } else if (job->type == JOB_AEAD_OPEN) {
+      job->result = ChaCha20Poly1305Open(job->input, job->inLen, job->aad, job->aadLen, keyStream,
+                                         keyStream+CHACHA_BLOCK_SIZE_BYTES, job->output, job->tag);
+    } else {
+      for (byte = 0; byte < job->inLen; byte++) {
+        job->output[byte] = job->input[byte] ^ keyStream[byte];
+      }
+      job->result = 0;
+    }
+  }
+  explicit_bzero(worker->keyStream, numBlocks * CHACHA_BLOCK_SIZE_BYTES);
+  explicit_bzero(worker->jobKeys, count * sizeof(struct chacha20Key));
+  pthread_mutex_lock(&worker->engine->lock);
+  worker->engine->stats.laneSlotsUsed += numBlocks;
+  worker->engine->stats.laneSlotsTotal += ((numBlocks + lanes - 1) / lanes) * lanes;
+  pthread_mutex_unlock(&worker->engine->lock);
+}
+
+// Function to run a large job on its own
+static void RunLargeJob(struct cryptoJob *job) {
+  struct sha256Ctx ctx;
+  struct chacha20Key jobKey;
+  const struct chacha20Key *chachaKey = CryptoJobKeyObject(job);
+
+  if ((job->type != JOB_HASH) && !chachaKey) {
+    ChaCha20KeyInit(&jobKey, job->key, job->nonce);
+    chachaKey = &jobKey;
+  }
+  switch (job->type) {
+    case JOB_HASH:
+      Sha256Init(&ctx);
+      job->result = Sha256Update(&ctx, job->input, job->inLen);
+      if (!job->result) {
+        job->result = Sha256Final(&ctx, job->output);
+      }
+      break;
+    case JOB_ENCRYPT:
+      job->result = ChaCha20KeyEncrypt(chachaKey, job->input, job->inLen, job->counter, job->output);
+      break;
+    case JOB_AEAD:
+      job->result = ChaCha20Poly1305KeyEncrypt(chachaKey, job->input, job->inLen,
+                                               job->aad, job->aadLen, job->output, job->tag);
+      break;
+    case JOB_AEAD_OPEN:
+      job->result = ChaCha20Poly1305KeyDecrypt(chachaKey, job->input, job->inLen,
+                                               job->aad, job->aadLen, job->output, job->tag);
+      break;
+  }
+  if (chachaKey == &jobKey) {
+    ChaCha20KeyWipe(&jobKey);
+  }
+}
+
+// Function to put finished jobs on the done list and signal the eventfd
+static void PostJobCompletions(struct cryptoJobEngine *engine, struct cryptoJob **jobs, unsigned int count) {
+  unsigned int ind;
+  uint64_t now = CryptoJobNowNs(), signal = 1;
+
+  pthread_mutex_lock(&engine->lock);
+  for (ind = 0; ind < count; ind++) {
+    jobs[ind]->doneNs = now;
+    jobs[ind]->next = NULL;
+    if (engine->doneTail) {
+      engine->doneTail->next = jobs[ind];
+    } else {
+      engine->doneHead = jobs[ind];
+    }
+    engine->doneTail = jobs[ind];
+    engine->stats.completed++;
+    engine->stats.inflightJobs--;
+    engine->stats.inflightBytes -= jobs[ind]->inLen + jobs[ind]->aadLen;
+  }
+  if (write(engine->eventFd, &signal, sizeof(signal)) < 0) {
+    fprintf(stderr, "ERROR - CRYPTO JOBS: eventfd write failed with errno %d.\n", errno);
+  }
+  pthread_mutex_unlock(&engine->lock);
+}
+
+/* Function to split a pickup into hash batch, keystream batch and large jobs.
+ * The small jobs run and are posted first, so a large job picked up with them
+ * does not hold back their completions. Each large job is posted when done.
+ */
+static void RunJobBatch(struct cryptoJobWorker *worker, struct cryptoJob **batch, unsigned int count) {
+  struct cryptoJob *hashJobs[CRYPTO_JOB_MAX_BATCH], *streamJobs[CRYPTO_JOB_MAX_BATCH], *largeJobs[CRYPTO_JOB_MAX_BATCH];
+  unsigned int ind, numHash = 0, numStream = 0, numLarge = 0;
+
+  for (ind = 0; ind < count; ind++) {
+    if (batch[ind]->inLen > CRYPTO_JOB_SMALL_BYTES) {
+      largeJobs[numLarge++] = batch[ind];
+    } else if (batch[ind]->type == JOB_HASH) {
+      hashJobs[numHash++] = batch[ind];
+    } else {
+      streamJobs[numStream++] = batch[ind];
+    }
+  }
+  if (numHash) {
+    RunHashBatch(worker, hashJobs, numHash);
+  }
+  if (numStream) {
+    RunStreamBatch(worker, streamJobs, numStream);
+  }
+  // Small completions go out before any large job starts
+  if (numHash + numStream) {
+    memcpy(hashJobs+numHash, streamJobs, numStream * sizeof(struct cryptoJob *));
+    PostJobCompletions(worker->engine, hashJobs, numHash + numStream);
+  }
+  for (ind = 0; ind < numLarge; ind++) {
+    RunLargeJob(largeJobs[ind]);
+    PostJobCompletions(worker->engine, &largeJobs[ind], 1);
+  }
+}
+
+// Worker thread: take everything queued up to a batch, run it and post the completions
+static void *CryptoJobWorkerMain(void *arg) {
+  struct cryptoJobWorker *worker = arg;
+  struct cryptoJobEngine *engine = worker->engine;
+  struct cryptoJob *batch[CRYPTO_JOB_MAX_BATCH];
+  unsigned int count;
+  uint64_t now, waited;
+
+  pthread_mutex_lock(&engine->lock);
+  while (1) {
+    while (!engine->pendingHead && !engine->stopping) {
+      pthread_cond_wait(&engine->workReady, &engine->lock);
+    }
+    // Queued jobs are still run when stopping
+    if (!engine->pendingHead) {
+      break;
+    }
+    now = CryptoJobNowNs();
+    for (count = 0; engine->pendingHead && (count < CRYPTO_JOB_MAX_BATCH); count++) {
+      batch[count] = engine->pendingHead;
+      engine->pendingHead = batch[count]->next;
+      batch[count]->startNs = now;
+      waited = now - batch[count]->submitNs;
+      engine->stats.queueNsTotal += waited;
+      if (waited > engine->stats.queueNsMax) {
+        engine->stats.queueNsMax = waited;
+      }
+    }
+    if (!engine->pendingHead) {
+      engine->pendingTail = NULL;
+    }
+    engine->stats.batches++;
+    engine->stats.batchedJobs += count;
+    pthread_mutex_unlock(&engine->lock);
+
+    RunJobBatch(worker, batch, count);
+    pthread_mutex_lock(&engine->lock);
+  }
+  pthread_mutex_unlock(&engine->lock);
+
+  return NULL;
+}
+
+/* Function to create an engine with numWorkers threads. maxInflightJobs and
+ * maxInflightBytes bound the jobs submitted but not yet finished, bytes being
+ * the input plus AAD length.
+ */
+struct cryptoJobEngine *CryptoJobEngineCreate(unsigned int numWorkers, unsigned long maxInflightJobs, unsigned long maxInflightBytes) {
+  struct cryptoJobEngine *engine;
+  unsigned int ind;
+
+  if (!numWorkers || !maxInflightJobs) {
+    fprintf(stderr, "ERROR - CRYPTO JOBS: the engine needs at least one worker and one job in flight.\n");
+    return NULL;
+  }
+  if (!(engine = calloc(1, sizeof(struct cryptoJobEngine)))) {
+    fprintf(stderr, "ERROR - CRYPTO JOBS: calloc failed to allocate the engine.\n");
+    return NULL;
+  }
+  engine->numWorkers = numWorkers;
+  engine->maxInflightJobs = maxInflightJobs;
+  engine->maxInflightBytes = maxInflightBytes;
+  pthread_mutex_init(&engine->lock, NULL);
+  pthread_cond_init(&engine->workReady, NULL);
+  if ((engine->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+    fprintf(stderr, "ERROR - CRYPTO JOBS: eventfd failed with errno %d.\n", errno);
+    CryptoJobEngineDestroy(engine);
+    return NULL;
+  }
+  // Workers hold cache line aligned key objects
+  if (posix_memalign((void **)&engine->workers, 64, numWorkers * sizeof(struct cryptoJobWorker))) {
+    fprintf(stderr, "ERROR - CRYPTO JOBS: posix_memalign failed to allocate the workers.\n");
+    engine->workers = NULL;
+    CryptoJobEngineDestroy(engine);
+    return NULL;
+  }
+  memset(engine->workers, 0, numWorkers * sizeof(struct cryptoJobWorker));
+  for (ind = 0; ind < numWorkers; ind++) {
+    engine->workers[ind].engine = engine;
+    if (!(engine->workers[ind].keyStream = calloc(CRYPTO_JOB_MAX_BLOCKS, CHACHA_BLOCK_SIZE_BYTES))) {
+      fprintf(stderr, "ERROR - CRYPTO JOBS: calloc failed to allocate a worker keystream buffer.\n");
+      CryptoJobEngineDestroy(engine);
+      return NULL;
+    }
+    if (pthread_create(&engine->workers[ind].thread, NULL, CryptoJobWorkerMain, &engine->workers[ind])) {
+      fprintf(stderr, "ERROR - CRYPTO JOBS: failed to start worker thread %u.\n", ind);
+      CryptoJobEngineDestroy(engine);
+      return NULL;
+    }
+    engine->numStarted++;
+  }
+
+  return engine;
+}
+
+// Function that returns the eventfd to poll for completions
+int CryptoJobEngineEventFd(struct cryptoJobEngine *engine) {
+  return engine ? engine->eventFd : ERR_JOB_ENGINE;
+}
+
+// Function to queue a job without blocking, fails with ERR_JOB_QUEUE_FULL past the in flight bounds
+int CryptoJobSubmit(struct cryptoJobEngine *engine, struct cryptoJob *job) {
+  unsigned long bytes;
+
+  if (!engine || !job || (!job->input && job->inLen) || !job->output
+      || ((job->type != JOB_HASH) && (job->type != JOB_ENCRYPT) && (job->type != JOB_AEAD) && (job->type != JOB_AEAD_OPEN))
+      || (job->flags & ~CRYPTO_JOB_KEY_OBJECT)
+      || ((job->flags & CRYPTO_JOB_KEY_OBJECT) && ((job->type == JOB_HASH) || !job->chachaKey))
+      || ((job->type != JOB_HASH) && !(job->flags & CRYPTO_JOB_KEY_OBJECT) && (!job->key || !job->nonce))
+      || (((job->type == JOB_AEAD) || (job->type == JOB_AEAD_OPEN)) && (!job->tag || (!job->aad && job->aadLen)))
+      || ((job->type == JOB_ENCRYPT) && (job->inLen > 0xffffffffUL))) {
+    fprintf(stderr, "ERROR - CRYPTO JOBS: invalid job passed to CryptoJobSubmit.\n");
+    return ERR_JOB_ENGINE;
+  }
+  bytes = job->inLen + job->aadLen;
+  job->result = 0;
+  job->next = NULL;
+  job->submitNs = CryptoJobNowNs();
+  job->startNs = job->doneNs = 0;
+
+  pthread_mutex_lock(&engine->lock);
+  // A job over the byte bound on its own is still let through when nothing else is in flight
+  if (engine->stopping || (engine->stats.inflightJobs >= engine->maxInflightJobs)
+      || (engine->stats.inflightJobs && ((engine->stats.inflightBytes + bytes) > engine->maxInflightBytes))) {
+    engine->stats.rejected++;
+    pthread_mutex_unlock(&engine->lock);
+    return ERR_JOB_QUEUE_FULL;
+  }
+  if (engine->pendingTail) {
+    engine->pendingTail->next = job;
+  } else {
+    engine->pendingHead = job;
+  }
+  engine->pendingTail = job;
+  engine->stats.submitted++;
+  engine->stats.inflightJobs++;
+  engine->stats.inflightBytes += bytes;
+  pthread_cond_signal(&engine->workReady);
+  pthread_mutex_unlock(&engine->lock);
+
+  return 0;
+}
+
+// Function to run the callbacks of every finished job on the calling thread, returns how many ran
+int CryptoJobReap(struct cryptoJobEngine *engine) {
+  struct cryptoJob *job, *next;
+  uint64_t signals;
+  int reaped = 0;
+
+  if (!engine) {
+    return ERR_JOB_ENGINE;
+  }
+  // Clear the eventfd before taking the list so a completion after this is signaled again
+  if ((read(engine->eventFd, &signals, sizeof(signals)) < 0) && (errno != EAGAIN)) {
+    fprintf(stderr, "ERROR - CRYPTO JOBS: eventfd read failed with errno %d.\n", errno);
+  }
+  pthread_mutex_lock(&engine->lock);
+  job = engine->doneHead;
+  engine->doneHead = engine->doneTail = NULL;
+  pthread_mutex_unlock(&engine->lock);
+
+  for (; job; job = next) {
+    next = job->next;
+    job->next = NULL;
+    if (job->callback) {
+      job->callback(job, job->callbackArg);
+    }
+    reaped++;
+  }
+
+  return reaped;
+}
+
+// Function to copy out the engine counters
+void CryptoJobEngineStats(struct cryptoJobEngine *engine, struct cryptoJobStats *stats) {
+  pthread_mutex_lock(&engine->lock);
+  memcpy(stats, &engine->stats, sizeof(struct cryptoJobStats));
+  pthread_mutex_unlock(&engine->lock);
+}
+
+// Function to finish every queued job, stop the workers and free the engine.
+// Callbacks of jobs not reaped by then are not run.
+void CryptoJobEngineDestroy(struct cryptoJobEngine *engine) {
+  unsigned int ind;
+
+  if (!engine) {
+    return;
+  }
+  pthread_mutex_lock(&engine->lock);
+  engine->stopping = 1;
+  pthread_cond_broadcast(&engine->workReady);
+  pthread_mutex_unlock(&engine->lock);
+  for (ind = 0; ind < engine->numStarted; ind++) {
+    pthread_join(engine->workers[ind].thread, NULL);
+  }
+  if (engine->workers) {
+    for (ind = 0; ind < engine->numWorkers; ind++) {
+      free(engine->workers[ind].keyStream);
+    }
+    free(engine->workers);
+  }
+  if (engine->eventFd >= 0) {
+    close(engine->eventFd);
+  }
+  pthread_mutex_destroy(&engine->lock);
+  pthread_cond_destroy(&engine->workReady);
+  free(engine);
+}
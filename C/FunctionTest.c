@@ -1,19 +1,52 @@
 #include <ctype.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "Crypto.h"
 
 // Pick an arbitrary max vector length for read in test vectors
 #define MAX_VECTOR_BYTE_LEN   2048
+// Buffer memory the manifest verifier may keep in flight
+#define MANIFEST_INFLIGHT_BYTES   (64UL << 20)
 
-// Function that prints a uniform error message for Sha256 errors
-void PrintRegressErrorSha256(void) {
-  fprintf(stderr, "ERROR - SHA256: invalid test vector file provided to regression.\n"); 
+// Function that returns the printable name of a SHA2 variant
+const char *Sha2Name(enum algorithm alg) {
+  switch (alg) {
+  case SHA224:
+    return "SHA224";
+  case SHA256:
+    return "SHA256";
+  case SHA384:
+    return "SHA384";
+  case SHA512:
+    return "SHA512";
+  case SHA512_256:
+    return "SHA512/256";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+// Function that maps a -a argument onto a SHA2 variant, 0 if unknown
+enum algorithm ParseSha2Name(char *name) {
+  if (!strcmp(name, "sha224")) return SHA224;
+  if (!strcmp(name, "sha256")) return SHA256;
+  if (!strcmp(name, "sha384")) return SHA384;
+  if (!strcmp(name, "sha512")) return SHA512;
+  if (!strcmp(name, "sha512_256")) return SHA512_256;
+  return 0;
+}
+
+// Function that prints a uniform error message for SHA2 errors
+void PrintRegressErrorSha2(enum algorithm alg) {
+  fprintf(stderr, "ERROR - %s: invalid test vector file provided to regression.\n", Sha2Name(alg)); 
   fprintf(stderr, "The file must contain pairs of lines where the first line is an input string within double quotes\n");
-  fprintf(stderr, "and the second line is a hex string output that is exactly 64 characters long.\n");
+  fprintf(stderr, "and the second line is a hex string output that is exactly %u characters long.\n", Sha2OutputBytes(alg)*2);
 }
 
 // Function that prints a uniform error message for ChaCha20 errors
@@ -39,20 +72,21 @@ int CheckHexString(unsigned char *input) {
 }
 
 // Function that prints a result for a given regression test
-int PrintRegressResultSha256(unsigned char *input, unsigned char *output, unsigned char *expected) {
+int PrintRegressResultSha2(enum algorithm alg, unsigned char *input, unsigned char *output, unsigned char *expected) {
   unsigned int expectedSize = strlen((const char *)expected);
+  unsigned int outputBytes = Sha2OutputBytes(alg);
   unsigned int result = 0, index;
-  unsigned char outputHex[65] = {0};
+  unsigned char outputHex[(SHA2_MAX_OUTPUT_BYTES*2)+1] = {0};
   int ret = 0;
 
   fprintf(stderr, "Input: %s\n", input);
   fprintf(stderr, "Result: ");
-  if (expectedSize != SHA256_OUTPUT_BYTES*2) {
-    fprintf(stderr, "FAILURE\nProvided expected output is an invalid size. Expecting 64 hex digits, found %d\n", expectedSize);
+  if (expectedSize != outputBytes*2) {
+    fprintf(stderr, "FAILURE\nProvided expected output is an invalid size. Expecting %u hex digits, found %d\n", outputBytes*2, expectedSize);
     return 1;
   }
 
-  for (index = 0; index < SHA256_OUTPUT_BYTES; index++) {
+  for (index = 0; index < outputBytes; index++) {
     sprintf((char *)(outputHex + (2*index)), "%02x", output[index]);
   }
 
@@ -68,24 +102,41 @@ int PrintRegressResultSha256(unsigned char *input, unsigned char *output, unsign
   return ret;
 }
 
-// Regression test top level function for sha256
-void RegressionSha256(FILE *testVecFile) {
+// Function that hashes an input through the streaming API in 7 byte pieces
+// and compares the digest against an expected one
+int CheckStreamingSha2(enum algorithm alg, unsigned char *input, unsigned long inLen, unsigned char *expected) {
+  struct sha2Ctx ctx;
+  unsigned char streamOut[SHA2_MAX_OUTPUT_BYTES];
+  unsigned long ind, take;
+
+  Sha2Init(&ctx, alg);
+  for (ind = 0; ind < inLen; ind += take) {
+    take = ((inLen - ind) < 7) ? (inLen - ind) : 7;
+    Sha2Update(&ctx, input+ind, take);
+  }
+  Sha2Final(&ctx, streamOut);
+
+  return memcmp(streamOut, expected, Sha2OutputBytes(alg)) ? 1 : 0;
+}
+
+// Regression test top level function for the SHA2 family
+void RegressionSha2(FILE *testVecFile, enum algorithm alg) {
   unsigned char line[(MAX_VECTOR_BYTE_LEN+1)], *input, *output, *targetOutput;
   unsigned int dataRead = 0;
   unsigned long inLenBits;
   int totalFailures = 0, totalTests = 0;
   
-  if (!(output = calloc(SHA256_OUTPUT_BYTES+1, sizeof(unsigned char)))) {
-    fprintf(stderr, "ERROR - SHA256 Regression: failed to allocate memory for output buffer. Regression will not run.\n");
+  if (!(output = calloc(SHA2_MAX_OUTPUT_BYTES+1, sizeof(unsigned char)))) {
+    fprintf(stderr, "ERROR - %s Regression: failed to allocate memory for output buffer. Regression will not run.\n", Sha2Name(alg));
     return;
   }
-  fprintf(stderr, "--- SHA256 Regression Test ---\n");
+  fprintf(stderr, "--- %s Regression Test ---\n", Sha2Name(alg));
   while (fgets((char *)line, MAX_VECTOR_BYTE_LEN, testVecFile) != NULL) {
     dataRead = strlen((const char *)line);
     if (dataRead == 1) {
       continue;
     } else if (line[dataRead-1] != '\n') {
-      PrintRegressErrorSha256();
+      PrintRegressErrorSha2(alg);
       free(output); output = NULL;
       break;
     }
@@ -95,7 +146,7 @@ void RegressionSha256(FILE *testVecFile) {
 
     // Make sure input line is within double quotes
     if ((line[0] != '"') || (line[dataRead-1] != '"')) {
-      PrintRegressErrorSha256();
+      PrintRegressErrorSha2(alg);
       free(output); output = NULL;
       break;
     }
@@ -107,7 +158,7 @@ void RegressionSha256(FILE *testVecFile) {
     memcpy(input, line+1, dataRead);
 
     if(!fgets((char *)line, MAX_VECTOR_BYTE_LEN, testVecFile)) {
-      PrintRegressErrorSha256();
+      PrintRegressErrorSha2(alg);
       free(input); input = NULL;
       free(output); output = NULL;
       break;
@@ -121,8 +172,15 @@ void RegressionSha256(FILE *testVecFile) {
 
     targetOutput = calloc(dataRead + 1, sizeof(unsigned char));
     memcpy(targetOutput, line, dataRead);
-    if (!ErikSha256(input, inLenBits, output)) {
-      totalFailures += PrintRegressResultSha256(input, output, targetOutput);
+    // SHA256 keeps checking the original bit length based implementation
+    if (((alg == SHA256) && !ErikSha256(input, inLenBits, output))
+        || ((alg != SHA256) && !ErikSha2(alg, input, inLenBits / 8, output))) {
+      totalFailures += PrintRegressResultSha2(alg, input, output, targetOutput);
+    }
+    // The streaming API must agree with the one shot function for any split
+    if (CheckStreamingSha2(alg, input, inLenBits / 8, output)) {
+      fprintf(stderr, "FAILURE\nStreaming output differs for input: %s\n\n", input);
+      totalFailures++;
     }
     totalTests++;
     free(input); input = NULL;
@@ -344,12 +402,526 @@ void RegressionChaCha20(FILE *testVecFile) {
   fprintf(stderr, "--- Total Failures: %d ---\n", totalFailures);
 }
 
+// Function that returns the seconds elapsed since a given start time
+double ElapsedSeconds(struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + ((now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+// Function to check that a forked child does not repeat its parent's RNG
+// stream. The parent draws first so the child inherits a seeded buffer.
+int CheckChaChaRngFork(void) {
+  unsigned char parentOut[32], childOut[32];
+  int fds[2], status;
+  ssize_t got = 0, ret;
+  pid_t pid;
+
+  if (ErikChaChaRngBytes(parentOut, 16) || pipe(fds)) {
+    return 1;
+  }
+  if (!(pid = fork())) {
+    close(fds[0]);
+    if (ErikChaChaRngBytes(childOut, sizeof(childOut)) || (write(fds[1], childOut, sizeof(childOut)) != sizeof(childOut))) {
+      _exit(1);
+    }
+    _exit(0);
+  }
+  close(fds[1]);
+  while ((pid > 0) && (got < (ssize_t)sizeof(childOut)) && ((ret = read(fds[0], childOut+got, sizeof(childOut)-got)) > 0)) {
+    got += ret;
+  }
+  close(fds[0]);
+  if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || WEXITSTATUS(status)
+      || (got != sizeof(childOut)) || ErikChaChaRngBytes(parentOut, sizeof(parentOut))) {
+    fprintf(stderr, "- Fork check could not run\n");
+    return 1;
+  }
+  return memcmp(parentOut, childOut, sizeof(parentOut)) ? 0 : 1;
+}
+
+// Check every multi-block ChaCha20 kernel the CPU supports against the single
+// block function, check fork safety and time the CSPRNG for small and bulk requests
+int BenchmarkChaChaRng(unsigned long numBytes) {
+  static const char *backendNames[] = {"", "portable", "avx2", "avx512"};
+  unsigned char key[CHACHA_KEY_SIZE_BYTES], nonce[CHACHA_NONCE_SIZE_BYTES];
+  unsigned char multiOut[((2*CHACHA_LANES)+3)*CHACHA_BLOCK_SIZE_BYTES], singleOut[CHACHA_BLOCK_SIZE_BYTES];
+  unsigned char *output;
+  unsigned long ind;
+  unsigned int numBlocks = (2*CHACHA_LANES)+3;
+  int failures = 0, kernelFailures, backend;
+  struct chacha20Key chachaKey;
+  struct timespec start;
+  double secs;
+
+  fprintf(stderr, "--- ChaCha20 RNG Test ---\n");
+  if (ErikChaChaRngBytes(key, sizeof(key)) || ErikChaChaRngBytes(nonce, sizeof(nonce))) {
+    return 1;
+  }
+  ChaCha20KeyInit(&chachaKey, key, nonce);
+  for (backend = CHACHA_BACKEND_PORTABLE; backend <= CHACHA_BACKEND_AVX512; backend++) {
+    if (ChaCha20KeyBlocksBackend(&chachaKey, 0xfffffffe, numBlocks, multiOut, backend)) {
+      fprintf(stderr, "Multi-block kernel (%s): not supported by this CPU\n", backendNames[backend]);
+      continue;
+    }
+    kernelFailures = 0;
+    for (ind = 0; ind < numBlocks; ind++) {
+      ChaCha20Block(key, nonce, 0xfffffffe + ind, singleOut);
+      if (memcmp(singleOut, multiOut+(ind*CHACHA_BLOCK_SIZE_BYTES), CHACHA_BLOCK_SIZE_BYTES)) {
+        fprintf(stderr, "- Multi-block kernel mismatch at block %lu\n", ind);
+        kernelFailures++;
+      }
+    }
+    fprintf(stderr, "Multi-block kernel (%s, %u lanes): %s\n", backendNames[backend], ChaCha20BackendLanes(backend),
+            kernelFailures ? "FAILURE" : "SUCCESS");
+    failures += kernelFailures;
+  }
+  ChaCha20KeyWipe(&chachaKey);
+  if (CheckChaChaRngFork()) {
+    failures++;
+    fprintf(stderr, "Fork reseed: FAILURE\n");
+  } else {
+    fprintf(stderr, "Fork reseed: SUCCESS\n");
+  }
+
+  if (!(output = calloc(numBytes+1, sizeof(unsigned char)))) {
+    fprintf(stderr, "ERROR - ChaCha20 RNG: failed to allocate memory for output buffer. Benchmark will not run.\n");
+    return 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (ind = 0; (ind + 16) <= numBytes; ind += 16) {
+    ErikChaChaRngBytes(output+ind, 16);
+  }
+  secs = ElapsedSeconds(&start);
+  fprintf(stderr, "16 byte requests: %lu bytes in %.3f s, %.2f MB/s\n", ind, secs, (ind / 1e6) / secs);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ErikChaChaRngBytes(output, numBytes);
+  secs = ElapsedSeconds(&start);
+  fprintf(stderr, "Single bulk request: %lu bytes in %.3f s, %.2f MB/s\n", numBytes, secs, (numBytes / 1e6) / secs);
+
+  free(output); output = NULL;
+  return failures ? 1 : 0;
+}
+
+// Benchmark hashing 256 byte prefixes with 32 byte suffixes, with and without
+// the prefix midstate cache, looked up by content and by a caller key
+void BenchmarkSha256Prefix(unsigned long iterations) {
+  unsigned char message[256+32], output[SHA256_OUTPUT_BYTES], expected[SHA256_OUTPUT_BYTES];
+  unsigned long ind;
+  struct sha256PrefixCache *cache;
+  struct timespec start;
+  double secs;
+  int failures = 0;
+
+  fprintf(stderr, "--- SHA256 Prefix Cache Benchmark ---\n");
+  if (!(cache = Sha256PrefixCacheCreate(16))) {
+    return;
+  }
+  for (ind = 0; ind < 256; ind++) {
+    message[ind] = 'A' + (ind % 26);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (ind = 0; ind < iterations; ind++) {
+    memcpy(message+256, &ind, sizeof(unsigned long));
+    ErikSha256(message, sizeof(message)*8, expected);
+  }
+  secs = ElapsedSeconds(&start);
+  fprintf(stderr, "ErikSha256: %lu messages in %.3f s, %.0f ns/message\n", iterations, secs, (secs * 1e9) / iterations);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (ind = 0; ind < iterations; ind++) {
+    memcpy(message+256, &ind, sizeof(unsigned long));
+    ErikSha256Prefixed(NULL, message, 256, message+256, 32, output);
+  }
+  secs = ElapsedSeconds(&start);
+  fprintf(stderr, "Streaming, no cache: %lu messages in %.3f s, %.0f ns/message\n", iterations, secs, (secs * 1e9) / iterations);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (ind = 0; ind < iterations; ind++) {
+    memcpy(message+256, &ind, sizeof(unsigned long));
+    ErikSha256Prefixed(cache, message, 256, message+256, 32, output);
+  }
+  secs = ElapsedSeconds(&start);
+  fprintf(stderr, "Prefix cache: %lu messages in %.3f s, %.0f ns/message\n", iterations, secs, (secs * 1e9) / iterations);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (ind = 0; ind < iterations; ind++) {
+    memcpy(message+256, &ind, sizeof(unsigned long));
+    ErikSha256PrefixedKey(cache, 1, message, 256, message+256, 32, output);
+  }
+  secs = ElapsedSeconds(&start);
+  fprintf(stderr, "Prefix cache, keyed: %lu messages in %.3f s, %.0f ns/message\n", iterations, secs, (secs * 1e9) / iterations);
+
+  // The last digest from every path must match
+  ErikSha256(message, sizeof(message)*8, expected);
+  failures += memcmp(output, expected, SHA256_OUTPUT_BYTES) ? 1 : 0;
+  ErikSha256Prefixed(NULL, message, 256, message+256, 32, output);
+  failures += memcmp(output, expected, SHA256_OUTPUT_BYTES) ? 1 : 0;
+  ErikSha256Prefixed(cache, message, 256, message+256, 32, output);
+  failures += memcmp(output, expected, SHA256_OUTPUT_BYTES) ? 1 : 0;
+  ErikSha256PrefixedKey(cache, 1, message, 256, message+256, 32, output);
+  failures += memcmp(output, expected, SHA256_OUTPUT_BYTES) ? 1 : 0;
+  // Invalid buffers are rejected, not read
+  failures += (ErikSha256Prefixed(cache, NULL, 256, message+256, 32, output) != ERR_SHA256_MAIN) ? 1 : 0;
+  failures += (ErikSha256Prefixed(cache, message, 256, NULL, 32, output) != ERR_SHA256_MAIN) ? 1 : 0;
+  failures += (ErikSha256PrefixedKey(cache, 1, message, 256, message+256, 32, NULL) != ERR_SHA256_MAIN) ? 1 : 0;
+  fprintf(stderr, "Digest check: %s\n", failures ? "FAILURE" : "SUCCESS");
+
+  Sha256PrefixCacheDestroy(cache);
+}
+
+// Benchmark bulk hashing with a SHA2 variant. For the SHA512 family every
+// compression backend the CPU supports is timed and checked against scalar.
+void BenchmarkSha2(enum algorithm alg, unsigned long numBytes) {
+  unsigned char *input, output[SHA2_MAX_OUTPUT_BYTES], streamOutput[SHA2_MAX_OUTPUT_BYTES];
+  unsigned long ind, take;
+  struct sha2Ctx ctx;
+  struct timespec start;
+  double secs;
+
+  fprintf(stderr, "--- %s Benchmark ---\n", Sha2Name(alg));
+  if (!(input = calloc(numBytes+1, sizeof(unsigned char)))) {
+    fprintf(stderr, "ERROR - %s Benchmark: failed to allocate memory for input buffer. Benchmark will not run.\n", Sha2Name(alg));
+    return;
+  }
+  for (ind = 0; ind < numBytes; ind++) {
+    input[ind] = ind * 131;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ErikSha2(alg, input, numBytes, output);
+  secs = ElapsedSeconds(&start);
+  fprintf(stderr, "ErikSha2: %lu bytes in %.3f s, %.2f MB/s\n", numBytes, secs, (numBytes / 1e6) / secs);
+
+  // Odd sized updates so most of them straddle a block boundary
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  Sha2Init(&ctx, alg);
+  for (ind = 0; ind < numBytes; ind += take) {
+    take = ((numBytes - ind) < 4093) ? (numBytes - ind) : 4093;
+    Sha2Update(&ctx, input+ind, take);
+  }
+  Sha2Final(&ctx, streamOutput);
+  secs = ElapsedSeconds(&start);
+  fprintf(stderr, "Streaming 4093 byte updates: %.2f MB/s, %s\n", (numBytes / 1e6) / secs,
+          memcmp(output, streamOutput, Sha2OutputBytes(alg)) ? "FAILURE" : "SUCCESS");
+
+  free(input); input = NULL;
+}
+
+// Completion callback for the job engine test, counts finished jobs
+void CountJobDone(struct cryptoJob *job, void *arg) {
+  (void)job;
+  (*(unsigned long *)arg)++;
+}
+
+// Function to check one finished engine job against the direct call
+int CheckCryptoJob(struct cryptoJob *job) {
+  unsigned char expected[CRYPTO_JOB_SMALL_BYTES*4], tag[POLY1305_TAG_SIZE_BYTES];
+  struct sha256Ctx ctx;
+
+  if (job->result) {
+    return 1;
+  }
+  switch (job->type) {
+    case JOB_HASH:
+      Sha256Init(&ctx);
+      Sha256Update(&ctx, job->input, job->inLen);
+      Sha256Final(&ctx, expected);
+      return memcmp(expected, job->output, SHA256_OUTPUT_BYTES) ? 1 : 0;
+    case JOB_ENCRYPT:
+      ErikChaCha20Encrypt(job->input, job->inLen, job->key, job->nonce, job->counter, expected);
+      return memcmp(expected, job->output, job->inLen) ? 1 : 0;
+    case JOB_AEAD:
+      ErikChaCha20Poly1305Encrypt(job->input, job->inLen, job->aad, job->aadLen, job->key, job->nonce, expected, tag);
+      return (memcmp(expected, job->output, job->inLen) || memcmp(tag, job->tag, POLY1305_TAG_SIZE_BYTES)) ? 1 : 0;
+    case JOB_AEAD_OPEN:
+      // Sealing the opened plaintext again must give back the ciphertext and tag
+      ErikChaCha20Poly1305Encrypt(job->output, job->inLen, job->aad, job->aadLen, job->key, job->nonce, expected, tag);
+      return (memcmp(expected, job->input, job->inLen) || memcmp(tag, job->tag, POLY1305_TAG_SIZE_BYTES)) ? 1 : 0;
+  }
+  return 1;
+}
+
+// Function to check an open job with a forged tag was rejected without writing plaintext
+int CheckForgedCryptoJob(struct cryptoJob *job) {
+  unsigned long ind;
+
+  if (job->result != ERR_POLY1305_AUTH) {
+    return 1;
+  }
+  for (ind = 0; ind < job->inLen; ind++) {
+    if (job->output[ind]) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Run a mix of hash, encrypt, AEAD seal and AEAD open jobs through the job
+// engine from a poll loop, check every result against the direct calls and
+// report queue latency and lane occupancy. Every other open job carries a
+// forged tag and must be rejected.
+int TestCryptoJobs(unsigned long numJobs, unsigned int numWorkers) {
+  unsigned char key[CHACHA_KEY_SIZE_BYTES], nonce[CHACHA_NONCE_SIZE_BYTES], aad[12];
+  unsigned char rfcTag[POLY1305_TAG_SIZE_BYTES], rfcOut[128];
+  unsigned char *input, *outputs, *tags, *ciphers;
+  const char *rfcPlain = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+  const unsigned char rfcExpectedTag[POLY1305_TAG_SIZE_BYTES] = {0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+                                                                 0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91};
+  unsigned long ind, submitted = 0, done = 0, forged = 0, numSmall = 0, inputBytes = CRYPTO_JOB_SMALL_BYTES*4;
+  uint64_t smallRunNs = 0, smallRunNsMax = 0;
+  struct cryptoJob *jobs;
+  struct chacha20Key chachaKey;
+  struct cryptoJobEngine *engine;
+  struct cryptoJobStats stats;
+  struct pollfd pfd;
+  struct timespec start;
+  double secs;
+  int failures = 0, ret;
+
+  fprintf(stderr, "--- Crypto Job Engine Test ---\n");
+  jobs = calloc(numJobs+1, sizeof(struct cryptoJob));
+  input = calloc(inputBytes, sizeof(unsigned char));
+  outputs = calloc((numJobs+1)*inputBytes, sizeof(unsigned char));
+  tags = calloc(numJobs+1, POLY1305_TAG_SIZE_BYTES);
+  ciphers = calloc(numJobs+1, inputBytes);
+  if (!jobs || !input || !outputs || !tags || !ciphers || !(engine = CryptoJobEngineCreate(numWorkers, 256, 1UL << 20))) {
+    fprintf(stderr, "ERROR - CRYPTO JOBS: failed to set up the job engine test.\n");
+    free(jobs); free(input); free(outputs); free(tags); free(ciphers);
+    return 1;
+  }
+  ErikChaChaRngBytes(input, inputBytes);
+  ErikChaChaRngBytes(key, sizeof(key));
+  ErikChaChaRngBytes(nonce, sizeof(nonce));
+  ErikChaChaRngBytes(aad, sizeof(aad));
+
+  // RFC 8439 section 2.8.2 AEAD vector goes first
+  for (ind = 0; ind < CHACHA_KEY_SIZE_BYTES; ind++) {
+    key[ind] = 0x80 + ind;
+  }
+  memcpy(nonce, "\x07\x00\x00\x00\x40\x41\x42\x43\x44\x45\x46\x47", CHACHA_NONCE_SIZE_BYTES);
+  memcpy(aad, "\x50\x51\x52\x53\xc0\xc1\xc2\xc3\xc4\xc5\xc6\xc7", sizeof(aad));
+  jobs[numJobs].type = JOB_AEAD;
+  jobs[numJobs].input = (unsigned char *)rfcPlain;
+  jobs[numJobs].inLen = strlen(rfcPlain);
+  jobs[numJobs].aad = aad;
+  jobs[numJobs].aadLen = sizeof(aad);
+  jobs[numJobs].key = key;
+  jobs[numJobs].nonce = nonce;
+  jobs[numJobs].output = rfcOut;
+  jobs[numJobs].tag = rfcTag;
+  jobs[numJobs].callback = CountJobDone;
+  jobs[numJobs].callbackArg = &done;
+  ChaCha20KeyInit(&chachaKey, key, nonce);
+
+  // Mostly small jobs of varied sizes, every 17th one large
+  for (ind = 0; ind < numJobs; ind++) {
+    jobs[ind].type = JOB_HASH + (ind % 4);
+    jobs[ind].input = input + (ind % 61);
+    jobs[ind].inLen = (ind % 17 == 16) ? (inputBytes - 64) : ((ind * 37) % (CRYPTO_JOB_SMALL_BYTES/4));
+    jobs[ind].aad = aad;
+    jobs[ind].aadLen = ind % 13;
+    jobs[ind].key = key;
+    jobs[ind].nonce = nonce;
+    jobs[ind].counter = ind;
+    jobs[ind].output = outputs + (ind * inputBytes);
+    jobs[ind].tag = tags + (ind * POLY1305_TAG_SIZE_BYTES);
+    jobs[ind].callback = CountJobDone;
+    jobs[ind].callbackArg = &done;
+    // Open jobs get a sealed message, half of them with one tag bit flipped
+    if (jobs[ind].type == JOB_AEAD_OPEN) {
+      ErikChaCha20Poly1305Encrypt(jobs[ind].input, jobs[ind].inLen, aad, jobs[ind].aadLen, key, nonce,
+                                  ciphers + (ind * inputBytes), jobs[ind].tag);
+      jobs[ind].input = ciphers + (ind * inputBytes);
+      if (ind % 8 == 7) {
+        jobs[ind].tag[ind % POLY1305_TAG_SIZE_BYTES] ^= 0x01;
+      }
+    }
+    // Some keyed jobs only carry the key object, key and nonce are put back for the checks
+    if ((jobs[ind].type != JOB_HASH) && (ind % 5 == 4)) {
+      jobs[ind].flags = CRYPTO_JOB_KEY_OBJECT;
+      jobs[ind].chachaKey = &chachaKey;
+      jobs[ind].key = jobs[ind].nonce = NULL;
+    }
+  }
+
+  pfd.fd = CryptoJobEngineEventFd(engine);
+  pfd.events = POLLIN;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ret = CryptoJobSubmit(engine, &jobs[numJobs]);
+  submitted = ret ? 0 : 1;
+  ind = 0;
+  while (done < numJobs+1) {
+    // Submit until the engine pushes back, then wait for completions
+    while ((ind < numJobs) && !(ret = CryptoJobSubmit(engine, &jobs[ind]))) {
+      ind++;
+      submitted++;
+    }
+    if ((ret != 0) && (ret != ERR_JOB_QUEUE_FULL)) {
+      failures++;
+      break;
+    }
+    if (done == submitted) {
+      // Only the RFC job could have been rejected if nothing is in flight
+      if (ind == numJobs) {
+        failures++;
+        break;
+      }
+      continue;
+    }
+    poll(&pfd, 1, -1);
+    CryptoJobReap(engine);
+  }
+  secs = ElapsedSeconds(&start);
+  CryptoJobEngineStats(engine, &stats);
+  CryptoJobEngineDestroy(engine);
+
+  ChaCha20KeyWipe(&chachaKey);
+  for (ind = 0; ind < numJobs; ind++) {
+    jobs[ind].key = key;
+    jobs[ind].nonce = nonce;
+    // Pickup to completion, which includes any large job posted ahead of it
+    if (jobs[ind].inLen <= CRYPTO_JOB_SMALL_BYTES) {
+      numSmall++;
+      smallRunNs += jobs[ind].doneNs - jobs[ind].startNs;
+      if ((jobs[ind].doneNs - jobs[ind].startNs) > smallRunNsMax) {
+        smallRunNsMax = jobs[ind].doneNs - jobs[ind].startNs;
+      }
+    }
+    if ((jobs[ind].type == JOB_AEAD_OPEN) && (ind % 8 == 7)) {
+      failures += CheckForgedCryptoJob(&jobs[ind]);
+      forged++;
+    } else {
+      failures += CheckCryptoJob(&jobs[ind]);
+    }
+  }
+  if (jobs[numJobs].result || memcmp(rfcTag, rfcExpectedTag, POLY1305_TAG_SIZE_BYTES) || (rfcOut[0] != 0xd3) || (rfcOut[1] != 0x1a)) {
+    fprintf(stderr, "- RFC 8439 AEAD vector mismatch\n");
+    failures++;
+  }
+  failures += CheckCryptoJob(&jobs[numJobs]);
+
+  fprintf(stderr, "%lu jobs on %u workers in %.3f s, %.0f jobs/s\n", numJobs+1, numWorkers, secs, (numJobs+1) / secs);
+  fprintf(stderr, "Rejected submits (queue full): %lu\n", (unsigned long)stats.rejected);
+  fprintf(stderr, "Forged AEAD tags: %lu\n", forged);
+  fprintf(stderr, "Queue latency: mean %.1f us, max %.1f us\n",
+          stats.completed ? (stats.queueNsTotal / 1e3) / stats.completed : 0.0, stats.queueNsMax / 1e3);
+  fprintf(stderr, "Small job pickup to done: mean %.1f us, max %.1f us\n",
+          numSmall ? (smallRunNs / 1e3) / numSmall : 0.0, smallRunNsMax / 1e3);
+  fprintf(stderr, "Batching: %lu pickups, %.1f jobs per pickup, lane occupancy %.1f%%\n", (unsigned long)stats.batches,
+          stats.batches ? (double)stats.batchedJobs / stats.batches : 0.0,
+          stats.laneSlotsTotal ? (100.0 * stats.laneSlotsUsed) / stats.laneSlotsTotal : 0.0);
+  fprintf(stderr, "Result check: %s\n", failures ? "FAILURE" : "SUCCESS");
+
+  free(jobs); free(input); free(outputs); free(tags); free(ciphers);
+  return failures ? 1 : 0;
+}
+
+// Emit callback for the chunking test, appends to the chunk array passed in
+void CollectCdcChunk(struct cdcChunk *chunk, void *arg) {
+  struct cdcChunk **next = arg;
+
+  memcpy((*next)++, chunk, sizeof(struct cdcChunk));
+}
+
+// Function to sort chunks by digest for the dedup count
+int CompareCdcDigest(const void *a, const void *b) {
+  return memcmp(((const struct cdcChunk *)a)->digest, ((const struct cdcChunk *)b)->digest, SHA256_OUTPUT_BYTES);
+}
+
+// Chunk and hash a file with the default sizes. The streaming chunker fed in
+// odd sized pieces, the single thread buffer path and the threaded buffer path
+// must agree, and every digest is checked against a plain sha256 of the chunk.
+int TestCdcFile(FILE *inFile, unsigned int numThreads) {
+  unsigned char *input, expected[SHA256_OUTPUT_BYTES];
+  unsigned long inLen, ind, piece, numStream, numSingle, numThreaded, unique, minLen = ~0UL, maxLen = 0;
+  struct cdcChunk *streamChunks, *next, *singleChunks = NULL, *threadedChunks = NULL;
+  struct cdcChunker chunker;
+  struct sha256Ctx ctx;
+  struct timespec start;
+  double singleSecs, threadedSecs;
+  int failures = 0;
+
+  fprintf(stderr, "--- Content Defined Chunking Test ---\n");
+  fseek(inFile, 0, SEEK_END);
+  inLen = ftell(inFile);
+  fseek(inFile, 0, SEEK_SET);
+  if (!(input = calloc(inLen+1, sizeof(unsigned char))) || (fread(input, 1, inLen, inFile) != inLen)
+      || !(streamChunks = calloc((inLen / CDC_DEFAULT_MIN_BYTES) + 1, sizeof(struct cdcChunk)))) {
+    fprintf(stderr, "ERROR - CDC: unable to read the input file into memory.\n");
+    free(input);
+    return 1;
+  }
+
+  next = streamChunks;
+  CdcInit(&chunker, CDC_DEFAULT_MIN_BYTES, CDC_DEFAULT_AVG_BYTES, CDC_DEFAULT_MAX_BYTES);
+  for (ind = 0; ind < inLen; ind += piece) {
+    piece = ((ind % 7919) + 1 < (inLen - ind)) ? (ind % 7919) + 1 : (inLen - ind);
+    CdcUpdate(&chunker, input+ind, piece, CollectCdcChunk, &next);
+  }
+  CdcFinal(&chunker, CollectCdcChunk, &next);
+  numStream = next - streamChunks;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  failures += ErikCdcChunkBuffer(input, inLen, CDC_DEFAULT_MIN_BYTES, CDC_DEFAULT_AVG_BYTES, CDC_DEFAULT_MAX_BYTES,
+                                 1, &singleChunks, &numSingle) ? 1 : 0;
+  singleSecs = ElapsedSeconds(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  failures += ErikCdcChunkBuffer(input, inLen, CDC_DEFAULT_MIN_BYTES, CDC_DEFAULT_AVG_BYTES, CDC_DEFAULT_MAX_BYTES,
+                                 numThreads, &threadedChunks, &numThreaded) ? 1 : 0;
+  threadedSecs = ElapsedSeconds(&start);
+
+  if (!failures && ((numStream != numSingle) || (numStream != numThreaded)
+      || memcmp(streamChunks, singleChunks, numStream * sizeof(struct cdcChunk))
+      || memcmp(streamChunks, threadedChunks, numStream * sizeof(struct cdcChunk)))) {
+    fprintf(stderr, "- Streaming, single thread and threaded chunk lists differ\n");
+    failures++;
+  }
+  for (ind = 0; !failures && (ind < numStream); ind++) {
+    Sha256Init(&ctx);
+    Sha256Update(&ctx, input+streamChunks[ind].offset, streamChunks[ind].len);
+    Sha256Final(&ctx, expected);
+    if (memcmp(expected, streamChunks[ind].digest, SHA256_OUTPUT_BYTES)) {
+      fprintf(stderr, "- Digest mismatch for chunk %lu\n", ind);
+      failures++;
+    }
+    minLen = (streamChunks[ind].len < minLen) ? streamChunks[ind].len : minLen;
+    maxLen = (streamChunks[ind].len > maxLen) ? streamChunks[ind].len : maxLen;
+  }
+
+  qsort(streamChunks, numStream, sizeof(struct cdcChunk), CompareCdcDigest);
+  for (ind = 0, unique = 0; ind < numStream; ind++) {
+    if (!ind || memcmp(streamChunks[ind].digest, streamChunks[ind-1].digest, SHA256_OUTPUT_BYTES)) {
+      unique++;
+    }
+  }
+  fprintf(stderr, "%lu bytes, %lu chunks, size min %lu avg %lu max %lu, %lu unique\n", inLen, numStream,
+          numStream ? minLen : 0, numStream ? inLen / numStream : 0, maxLen, unique);
+  fprintf(stderr, "1 thread: %.2f MB/s, %u threads: %.2f MB/s\n", (inLen / 1e6) / singleSecs, numThreads, (inLen / 1e6) / threadedSecs);
+  fprintf(stderr, "Result check: %s\n", failures ? "FAILURE" : "SUCCESS");
+
+  free(input); free(streamChunks); free(singleChunks); free(threadedChunks);
+  return failures ? 1 : 0;
+}
+
 // Simple help menu for a user
 void PrintHelp(void) {
   fprintf(stderr, "Usage:\n");
+  fprintf(stderr, " -a <algorithm>: SHA2 variant used by -g and -s, one of sha224, sha256 (default), sha384, sha512, sha512_256\n");
+  fprintf(stderr, " -b <numBytes>: benchmark the SHA2 variant selected by -a over <numBytes> bytes\n");
   fprintf(stderr, " -c <filename>: run ChaCha20 regression>\n");
-  fprintf(stderr, " -g <string>: generate sha256 hash of <string>\n");
-  fprintf(stderr, " -s <filename>: run sha256 regression\n");
+  fprintf(stderr, " -d <filename>: content defined chunking of a file with per chunk sha256, -j sets the hashing threads\n");
+  fprintf(stderr, " -g <string>: generate SHA2 hash of <string>\n");
+  fprintf(stderr, " -p <iterations>: benchmark sha256 with a cached 256 byte prefix and 32 byte suffixes\n");
+  fprintf(stderr, " -r <numBytes>: check and benchmark the ChaCha20 RNG over <numBytes> bytes\n");
+  fprintf(stderr, " -s <filename>: run SHA2 regression\n");
+  fprintf(stderr, " -j <numThreads>: reader and hashing threads used by -m, defaults to the number of CPUs\n");
+  fprintf(stderr, " -m <filename>: verify every file of a sha256sum style manifest\n");
+  fprintf(stderr, " -q <numJobs>: run and check a mix of hash, encrypt and AEAD jobs through the job engine, -j sets the workers\n");
+  fprintf(stderr, " -t: print the instrumentation counters when done (build with make STATS=1)\n");
   fprintf(stderr, " -h: print help menu\n");
 }
 
@@ -361,10 +933,23 @@ int main(int argc, char *argv[]) {
   unsigned int sha256RegressFlag = 0;
   unsigned int sha256GenFlag = 0;
   unsigned int chacha20RegressFlag = 0;
+  unsigned int rngFlag = 0;
+  unsigned long rngBytes = 0;
+  unsigned int prefixBenchFlag = 0;
+  unsigned long prefixIterations = 0;
   unsigned char *sha256File;
   unsigned char *chacha20File;
   unsigned char *inputStr;
-  unsigned char outputsha256[SHA256_OUTPUT_BYTES+1] = {0};
+  unsigned char outputsha256[SHA2_MAX_OUTPUT_BYTES+1] = {0};
+  enum algorithm sha2Alg = SHA256;
+  unsigned long sha2BenchBytes = 0;
+  unsigned char *manifestFile = NULL;
+  long numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  int ret = 0;
+  unsigned int statsFlag = 0;
+  unsigned long jobCount = 0;
+  unsigned char *cdcFile = NULL;
+  struct cryptoStatsSnapshot *statsSnap;
 
   if (sizeof(unsigned long) != 8) {
     fprintf(stderr, "WARNING - SHA256: unsigned long is %lu bytes instead of expected 8. The max input length is affected.\n", sizeof(unsigned long));
@@ -375,14 +960,27 @@ int main(int argc, char *argv[]) {
       return 0;
   }
 
-  while ((c = getopt (argc, argv, "s:g:c:h")) != -1) {
+  while ((c = getopt (argc, argv, "a:b:s:g:c:d:j:m:p:q:r:th")) != -1) {
     switch (c)
       {
+      case 'a':
+        if (!(sha2Alg = ParseSha2Name(optarg))) {
+          fprintf(stderr, "ERROR - SHA2: unknown algorithm %s.\n", optarg);
+          PrintHelp();
+          return 1;
+        }
+        break;
+      case 'b':
+        sha2BenchBytes = strtoul(optarg, NULL, 10);
+        break;
       case 'c':
         //ChaCha20Test();
         chacha20RegressFlag = 1;
         chacha20File = (unsigned char *)optarg;
         break;
+      case 'd':
+        cdcFile = (unsigned char *)optarg;
+        break;
       case 's':
         sha256RegressFlag = 1;
         sha256File = (unsigned char *)optarg;
@@ -395,6 +993,26 @@ int main(int argc, char *argv[]) {
         }
         memcpy(inputStr, optarg, strlen(optarg));
         break;
+      case 'j':
+        numThreads = strtol(optarg, NULL, 10);
+        break;
+      case 'm':
+        manifestFile = (unsigned char *)optarg;
+        break;
+      case 'p':
+        prefixBenchFlag = 1;
+        prefixIterations = strtoul(optarg, NULL, 10);
+        break;
+      case 'q':
+        jobCount = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        rngFlag = 1;
+        rngBytes = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        statsFlag = 1;
+        break;
       case 'h':
         PrintHelp();
         break;
@@ -408,7 +1026,7 @@ int main(int argc, char *argv[]) {
       fprintf(stderr, "ERROR - SHA256: Unable to open provided test vector file %s.\n", sha256File);
       return 1;
     }
-    RegressionSha256(testFile);
+    RegressionSha2(testFile, sha2Alg);
     fclose(testFile);
   }
 
@@ -420,12 +1038,55 @@ int main(int argc, char *argv[]) {
     RegressionChaCha20(testFile);
     fclose(testFile);
   }
+  if (manifestFile) {
+    if (!(testFile = fopen((const char *)manifestFile, "r"))) {
+      fprintf(stderr, "ERROR - MANIFEST: Unable to open provided manifest file %s.\n", manifestFile);
+      return 1;
+    }
+    if (numThreads < 1) {
+      numThreads = 1;
+    }
+    ret = ErikVerifyManifest(testFile, numThreads, numThreads, MANIFEST_INFLIGHT_BYTES) ? 1 : 0;
+    fclose(testFile);
+  }
+  if (cdcFile) {
+    if (!(testFile = fopen((const char *)cdcFile, "rb"))) {
+      fprintf(stderr, "ERROR - CDC: Unable to open provided input file %s.\n", cdcFile);
+      return 1;
+    }
+    ret |= TestCdcFile(testFile, (numThreads < 1) ? 1 : numThreads);
+    fclose(testFile);
+  }
+  if (sha2BenchBytes) {
+    BenchmarkSha2(sha2Alg, sha2BenchBytes);
+  }
+  if (prefixBenchFlag) {
+    BenchmarkSha256Prefix(prefixIterations);
+  }
+  if (rngFlag) {
+    ret |= BenchmarkChaChaRng(rngBytes);
+  }
+  if (jobCount) {
+    ret |= TestCryptoJobs(jobCount, (numThreads < 1) ? 1 : numThreads);
+  }
   if (sha256GenFlag) {
     inLenBits = strlen((const char *)inputStr) * 8;
-    ErikSha256(inputStr, inLenBits, outputsha256);
-    DumpHexString((unsigned char *)outputsha256, SHA256_OUTPUT_BITS);
+    if (sha2Alg == SHA256) {
+      ErikSha256(inputStr, inLenBits, outputsha256);
+    } else {
+      ErikSha2(sha2Alg, inputStr, inLenBits / 8, outputsha256);
+    }
+    DumpHexString((unsigned char *)outputsha256, Sha2OutputBytes(sha2Alg)*8);
     free(inputStr);
   }
+  if (statsFlag && (statsSnap = calloc(1, sizeof(struct cryptoStatsSnapshot)))) {
+    if (CryptoStatsSnapshot(statsSnap)) {
+      fprintf(stderr, "WARNING - instrumentation is compiled out, rebuild with make STATS=1.\n");
+    } else {
+      CryptoStatsPrint(stderr, statsSnap);
+    }
+    free(statsSnap);
+  }
 
-  return 0;
+  return ret;
 }
\ No newline at end of file
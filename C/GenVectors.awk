@@ -0,0 +1,36 @@
+# Description: Turn a regression vector file into C++ initializer lines
+#
+# Usage: awk -v format=<sha256|chacha20> -f GenVectors.awk <Regression.txt>
+#
+# Vectors are separated by blank lines, the same layout FunctionTest.c reads.
+# sha256 vectors give
+#   {"input", "digest"},
+# and chacha20 vectors give
+#   {"input", false, "key", "nonce", counter, "cipher"},
+# with true in the second field when the input line is hex, not quoted text.
+
+function IsQuoted(line) {
+  return substr(line, 1, 1) == "\""
+}
+
+function Literal(line) {
+  if (IsQuoted(line)) {
+    line = substr(line, 2, length(line) - 2)
+    gsub(/[\\"]/, "\\\\&", line)
+  }
+  return "\"" line "\""
+}
+
+BEGIN {
+  RS = ""
+  FS = "\n"
+  print "// Generated from " ARGV[1] " by GenVectors.awk, do not edit"
+}
+
+format == "sha256" && NF >= 2 {
+  printf("{%s, \"%s\"},\n", Literal($1), $2)
+}
+
+format == "chacha20" && NF >= 5 {
+  printf("{%s, %s, \"%s\", \"%s\", %s, \"%s\"},\n", Literal($1), IsQuoted($1) ? "false" : "true", $2, $3, $4, $5)
+}
@@ -0,0 +1,431 @@
+/* Description: Parallel verification of a manifest of file digests
+ *
+ * The manifest uses the sha256sum format, one "<64 hex digits>  <path>" line
+ * per file. Files are sorted largest first so the long ones start early, then
+ * a set of reader threads fills a fixed pool of aligned chunk buffers while a
+ * pool of hashing workers streams each file's chunks through the SHA256 core.
+ * The buffer pool bounds the memory in flight: readers block when it is empty
+ * and workers hand buffers back as soon as a chunk is hashed.
+ *
+ * A file's chunks must be hashed in order, so a file is owned by at most one
+ * worker at a time. Files with chunks waiting and no owner sit on a ready
+ * queue that idle workers pull from.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Crypto.h"
+
+#define MANIFEST_PENDING          0
+#define MANIFEST_OK               1
+#define MANIFEST_MISMATCH         2
+#define MANIFEST_IO_ERROR         3
+
+struct manifestChunk {
+  unsigned char *data;
+  unsigned long len;
+  struct manifestChunk *next;
+};
+
+struct manifestEntry {
+  char *path;
+  unsigned char expected[SHA256_OUTPUT_BYTES];
+  unsigned char digest[SHA256_OUTPUT_BYTES];
+  unsigned long size, hashedBytes;
+  struct sha256Ctx ctx;
+  struct manifestChunk *head, *tail;   // read but not hashed yet
+  struct manifestEntry *nextReady;
+  int readDone, owned, queued, status, ioErrno;
+};
+
+struct manifestVerifier {
+  struct manifestEntry *entries;
+  unsigned long numEntries, nextRead, numDone;
+  struct manifestChunk *chunks, *freeChunks;
+  unsigned long numChunks;
+  struct manifestEntry *readyHead, *readyTail;
+  int aborted;
+  pthread_mutex_t lock;
+  pthread_cond_t chunkFree, workReady;
+};
+
+// Function to sort entries largest file first
+static int CompareEntrySize(const void *a, const void *b) {
+  const struct manifestEntry *entryA = a, *entryB = b;
+
+  if (entryA->size == entryB->size) {
+    return 0;
+  }
+  return (entryA->size < entryB->size) ? 1 : -1;
+}
+
+// Function to parse one "<hex digest>  <path>" manifest line into an entry
+static int ParseManifestLine(char *line, struct manifestEntry *entry) {
+  unsigned int ind, len = strlen(line);
+  char hexByte[3] = {0};
+  char *path;
+
+  while (len && ((line[len-1] == '\n') || (line[len-1] == '\r'))) {
+    line[--len] = 0x0;
+  }
+  // Digest, a separator, then an optional '*' binary marker before the path
+  if ((len < (SHA256_OUTPUT_BYTES*2) + 2) || (line[SHA256_OUTPUT_BYTES*2] != ' ')) {
+    return ERR_MANIFEST;
+  }
+  for (ind = 0; ind < SHA256_OUTPUT_BYTES*2; ind++) {
+    if (!isxdigit((unsigned char)line[ind])) {
+      return ERR_MANIFEST;
+    }
+  }
+  for (ind = 0; ind < SHA256_OUTPUT_BYTES; ind++) {
+    memcpy(hexByte, line+(2*ind), 2);
+    entry->expected[ind] = strtoul(hexByte, NULL, 16);
+  }
+  path = line + (SHA256_OUTPUT_BYTES*2) + 1;
+  if ((*path == ' ') || (*path == '*')) {
+    path++;
+  }
+  if (!*path || !(entry->path = strdup(path))) {
+    return ERR_MANIFEST;
+  }
+
+  return 0;
+}
+
+// Function to put an entry on the ready queue, called with the lock held
+static void QueueReadyEntry(struct manifestVerifier *verifier, struct manifestEntry *entry) {
+  if (entry->owned || entry->queued) {
+    return;
+  }
+  entry->queued = 1;
+  entry->nextReady = NULL;
+  if (verifier->readyTail) {
+    verifier->readyTail->nextReady = entry;
+  } else {
+    verifier->readyHead = entry;
+  }
+  verifier->readyTail = entry;
+  pthread_cond_signal(&verifier->workReady);
+}
+
+// Function to read a whole file into chunks, waiting on the buffer pool
+static void ReadManifestEntry(struct manifestVerifier *verifier, struct manifestEntry *entry) {
+  struct manifestChunk *chunk;
+  ssize_t ret;
+  int fd, readErrno = 0, done = 0;
+
+  if ((fd = open(entry->path, O_RDONLY)) < 0) {
+    readErrno = errno;
+    done = 1;
+  } else {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  while (!done) {
+    pthread_mutex_lock(&verifier->lock);
+    while (!verifier->freeChunks && !verifier->aborted) {
+      pthread_cond_wait(&verifier->chunkFree, &verifier->lock);
+    }
+    if (verifier->aborted) {
+      pthread_mutex_unlock(&verifier->lock);
+      readErrno = ECANCELED;
+      break;
+    }
+    chunk = verifier->freeChunks;
+    verifier->freeChunks = chunk->next;
+    pthread_mutex_unlock(&verifier->lock);
+
+    // Fill the whole chunk unless the file ends first
+    chunk->len = 0;
+    while (chunk->len < MANIFEST_CHUNK_BYTES) {
+      ret = read(fd, chunk->data+chunk->len, MANIFEST_CHUNK_BYTES-chunk->len);
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        readErrno = errno;
+        break;
+      }
+      if (!ret) {
+        break;
+      }
+      chunk->len += ret;
+    }
+    done = (chunk->len < MANIFEST_CHUNK_BYTES) || readErrno;
+
+    pthread_mutex_lock(&verifier->lock);
+    if (chunk->len && !readErrno) {
+      chunk->next = NULL;
+      if (entry->tail) {
+        entry->tail->next = chunk;
+      } else {
+        entry->head = chunk;
+      }
+      entry->tail = chunk;
+      QueueReadyEntry(verifier, entry);
+    } else {
+      chunk->next = verifier->freeChunks;
+      verifier->freeChunks = chunk;
+      pthread_cond_signal(&verifier->chunkFree);
+    }
+    pthread_mutex_unlock(&verifier->lock);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+
+  pthread_mutex_lock(&verifier->lock);
+  entry->ioErrno = readErrno;
+  entry->readDone = 1;
+  QueueReadyEntry(verifier, entry);
+  pthread_mutex_unlock(&verifier->lock);
+}
+
+// Reader thread: claim files in size order until none are left
+static void *ManifestReader(void *arg) {
+  struct manifestVerifier *verifier = arg;
+  unsigned long index;
+
+  for (;;) {
+    pthread_mutex_lock(&verifier->lock);
+    index = verifier->nextRead++;
+    pthread_mutex_unlock(&verifier->lock);
+    if (index >= verifier->numEntries) {
+      return NULL;
+    }
+    ReadManifestEntry(verifier, &verifier->entries[index]);
+  }
+}
+
+// Hashing worker: own a ready file, hash every chunk it has, finish it once read
+static void *ManifestWorker(void *arg) {
+  struct manifestVerifier *verifier = arg;
+  struct manifestEntry *entry;
+  struct manifestChunk *chunks, *chunk;
+
+  pthread_mutex_lock(&verifier->lock);
+  for (;;) {
+    while (!verifier->readyHead && (verifier->numDone < verifier->numEntries) && !verifier->aborted) {
+      pthread_cond_wait(&verifier->workReady, &verifier->lock);
+    }
+    if (!verifier->readyHead || verifier->aborted) {
+      break;
+    }
+    entry = verifier->readyHead;
+    verifier->readyHead = entry->nextReady;
+    if (!verifier->readyHead) {
+      verifier->readyTail = NULL;
+    }
+    entry->queued = 0;
+    entry->owned = 1;
+
+    while (entry->head) {
+      chunks = entry->head;
+      entry->head = entry->tail = NULL;
+      pthread_mutex_unlock(&verifier->lock);
+      for (chunk = chunks; chunk; chunk = chunk->next) {
+        Sha256Update(&entry->ctx, chunk->data, chunk->len);
+        entry->hashedBytes += chunk->len;
+      }
+      pthread_mutex_lock(&verifier->lock);
+      // Hand the buffers back to the readers
+      while (chunks) {
+        chunk = chunks;
+        chunks = chunk->next;
+        chunk->next = verifier->freeChunks;
+        verifier->freeChunks = chunk;
+      }
+      pthread_cond_broadcast(&verifier->chunkFree);
+    }
+
+    entry->owned = 0;
+    if (entry->readDone) {
+      if (entry->ioErrno) {
+        entry->status = MANIFEST_IO_ERROR;
+      } else {
+        Sha256Final(&entry->ctx, entry->digest);
+        entry->status = memcmp(entry->digest, entry->expected, SHA256_OUTPUT_BYTES) ? MANIFEST_MISMATCH : MANIFEST_OK;
+      }
+      if (++verifier->numDone == verifier->numEntries) {
+        pthread_cond_broadcast(&verifier->workReady);
+      }
+    }
+  }
+  pthread_mutex_unlock(&verifier->lock);
+
+  return NULL;
+}
+
+// Function to print a digest as lower case hex
+static void PrintDigestHex(unsigned char *digest) {
+  unsigned int ind;
+
+  for (ind = 0; ind < SHA256_OUTPUT_BYTES; ind++) {
+    fprintf(stderr, "%02x", digest[ind]);
+  }
+}
+
+/* Verify every file listed in a manifest. Returns the number of files that
+ * did not match or could not be read, or a negative error.
+ */
+int ErikVerifyManifest(FILE *manifestFile, unsigned int numReaders, unsigned int numWorkers, unsigned long maxInflightBytes) {
+  struct manifestVerifier verifier;
+  struct manifestEntry *entries = NULL, *grown;
+  unsigned long numEntries = 0, capEntries = 0, lineNum = 0, okBytes = 0, failedBytes = 0, ind;
+  pthread_t *threads = NULL;
+  unsigned int numThreads = 0, thread;
+  struct timespec start, end;
+  struct stat fileStat;
+  char *line = NULL;
+  size_t lineCap = 0;
+  double secs;
+  int failures = 0, ret = 0;
+
+  if (!manifestFile || !numReaders || !numWorkers) {
+    fprintf(stderr, "ERROR - MANIFEST: invalid input to top level function.\n");
+    return ERR_MANIFEST;
+  }
+  memset(&verifier, 0, sizeof(verifier));
+
+  while (getline(&line, &lineCap, manifestFile) > 0) {
+    lineNum++;
+    if ((line[0] == '\n') || (line[0] == '#')) {
+      continue;
+    }
+    if (numEntries == capEntries) {
+      capEntries = capEntries ? (capEntries * 2) : 64;
+      if (!(grown = realloc(entries, capEntries * sizeof(struct manifestEntry)))) {
+        fprintf(stderr, "ERROR - MANIFEST: unable to allocate memory for manifest entries.\n");
+        ret = ERR_ALLOC;
+        goto cleanup;
+      }
+      entries = grown;
+    }
+    memset(&entries[numEntries], 0, sizeof(struct manifestEntry));
+    if (ParseManifestLine(line, &entries[numEntries])) {
+      fprintf(stderr, "ERROR - MANIFEST: line %lu is not \"<64 hex digits>  <path>\".\n", lineNum);
+      ret = ERR_MANIFEST;
+      goto cleanup;
+    }
+    if (!stat(entries[numEntries].path, &fileStat)) {
+      entries[numEntries].size = fileStat.st_size;
+    }
+    Sha256Init(&entries[numEntries].ctx);
+    numEntries++;
+  }
+  if (!numEntries) {
+    fprintf(stderr, "--- Manifest is empty ---\n");
+    goto cleanup;
+  }
+  qsort(entries, numEntries, sizeof(struct manifestEntry), CompareEntrySize);
+  verifier.entries = entries;
+  verifier.numEntries = numEntries;
+
+  // Bounded buffer pool, at least one chunk per reader
+  verifier.numChunks = maxInflightBytes / MANIFEST_CHUNK_BYTES;
+  if (verifier.numChunks < numReaders) {
+    verifier.numChunks = numReaders;
+  }
+  if (!(verifier.chunks = calloc(verifier.numChunks, sizeof(struct manifestChunk)))) {
+    fprintf(stderr, "ERROR - MANIFEST: unable to allocate memory for the buffer pool.\n");
+    ret = ERR_ALLOC;
+    goto cleanup;
+  }
+  for (ind = 0; ind < verifier.numChunks; ind++) {
+    if (posix_memalign((void **)&verifier.chunks[ind].data, 4096, MANIFEST_CHUNK_BYTES)) {
+      fprintf(stderr, "ERROR - MANIFEST: unable to allocate memory for the buffer pool.\n");
+      ret = ERR_ALLOC;
+      goto cleanup;
+    }
+    verifier.chunks[ind].next = verifier.freeChunks;
+    verifier.freeChunks = &verifier.chunks[ind];
+  }
+
+  pthread_mutex_init(&verifier.lock, NULL);
+  pthread_cond_init(&verifier.chunkFree, NULL);
+  pthread_cond_init(&verifier.workReady, NULL);
+  if (!(threads = calloc(numReaders + numWorkers, sizeof(pthread_t)))) {
+    fprintf(stderr, "ERROR - MANIFEST: unable to allocate memory for threads.\n");
+    ret = ERR_ALLOC;
+    goto destroy;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (thread = 0; thread < (numReaders + numWorkers); thread++) {
+    if (pthread_create(&threads[thread], NULL, (thread < numReaders) ? ManifestReader : ManifestWorker, &verifier)) {
+      fprintf(stderr, "ERROR - MANIFEST: unable to start thread %u.\n", thread);
+      ret = ERR_MANIFEST;
+      break;
+    }
+    numThreads++;
+  }
+  // Without a full set of threads nothing guarantees the pipeline drains
+  if (ret) {
+    pthread_mutex_lock(&verifier.lock);
+    verifier.nextRead = verifier.numEntries;
+    verifier.aborted = 1;
+    pthread_cond_broadcast(&verifier.chunkFree);
+    pthread_cond_broadcast(&verifier.workReady);
+    pthread_mutex_unlock(&verifier.lock);
+  }
+  for (thread = 0; thread < numThreads; thread++) {
+    pthread_join(threads[thread], NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (ret) {
+    goto destroy;
+  }
+
+  for (ind = 0; ind < numEntries; ind++) {
+    // Throughput counts what was hashed, a short read or mismatch still cost the work
+    if (entries[ind].status == MANIFEST_OK) {
+      okBytes += entries[ind].hashedBytes;
+      continue;
+    }
+    failedBytes += entries[ind].hashedBytes;
+    failures++;
+    if (entries[ind].status == MANIFEST_IO_ERROR) {
+      fprintf(stderr, "IO ERROR: %s: %s\n", entries[ind].path, strerror(entries[ind].ioErrno));
+    } else {
+      fprintf(stderr, "MISMATCH: %s\n   - expected ", entries[ind].path);
+      PrintDigestHex(entries[ind].expected);
+      fprintf(stderr, "\n   - received ");
+      PrintDigestHex(entries[ind].digest);
+      fprintf(stderr, "\n");
+    }
+  }
+  secs = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1e9);
+  fprintf(stderr, "--- Total Files: %lu ---\n", numEntries);
+  fprintf(stderr, "--- Total Successes: %lu ---\n", numEntries - failures);
+  fprintf(stderr, "--- Total Failures: %d ---\n", failures);
+  fprintf(stderr, "--- Hashed %lu bytes (%lu verified, %lu in failed files) in %.3f s, %.3f GB/s ---\n",
+          okBytes + failedBytes, okBytes, failedBytes, secs, ((okBytes + failedBytes) / 1e9) / secs);
+  ret = failures;
+
+destroy:
+  pthread_mutex_destroy(&verifier.lock);
+  pthread_cond_destroy(&verifier.chunkFree);
+  pthread_cond_destroy(&verifier.workReady);
+cleanup:
+  if (verifier.chunks) {
+    for (ind = 0; ind < verifier.numChunks; ind++) {
+      free(verifier.chunks[ind].data);
+    }
+  }
+  free(verifier.chunks);
+  for (ind = 0; ind < numEntries; ind++) {
+    free(entries[ind].path);
+  }
+  free(entries);
+  free(threads);
+  free(line);
+
+  return ret;
+}
@@ -0,0 +1,74 @@
+/* Description: Check of the USDT probe path of the instrumentation
+ *
+ * Built by make probe-check with CRYPTO_STATS=1 against the <sys/sdt.h> stub
+ * in probes/. Every top level operation is called on a good input, on each
+ * rejected input and, for ErikSha256, on a failed allocation. Every op_entry probe must be paired with an op_exit
+ * probe for the same operation, and every exit must have left one latency
+ * sample. No entries at all means the stub was not picked up.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Crypto.h"
+
+static unsigned long probeEntries[STAT_NUM_OPS], probeExits[STAT_NUM_OPS];
+
+// Called from every probe site through the stub DTRACE_PROBE2
+void CryptoProbeHit(const char *probe, long op, long len) {
+  (void)len;
+  if ((op < 0) || (op >= STAT_NUM_OPS)) {
+    return;
+  }
+  if (!strcmp(probe, "op_entry")) {
+    probeEntries[op]++;
+  } else if (!strcmp(probe, "op_exit")) {
+    probeExits[op]++;
+  }
+}
+
+int main(void) {
+  static const char *opNames[STAT_NUM_OPS] = {"ErikSha256", "ErikSha2", "ErikChaCha20Encrypt"};
+  unsigned char input[200] = {0}, output[SHA2_MAX_OUTPUT_BYTES], key[CHACHA_KEY_SIZE_BYTES] = {0};
+  unsigned char nonce[CHACHA_NONCE_SIZE_BYTES] = {0};
+  struct cryptoStatsSnapshot snap;
+  unsigned long samples;
+  int op, size, bucket, failures = 0;
+
+  fprintf(stderr, "--- USDT Probe Pairing Test ---\n");
+  // Good inputs, then every rejected input of each operation
+  ErikSha256(input, sizeof(input)*8, output);
+  ErikSha256(input, sizeof(input)*8, NULL);
+  ErikSha256(NULL, sizeof(input)*8, output);
+  // A length no calloc can satisfy takes the allocation failure exit
+  ErikSha256(input, ~7UL, output);
+  ErikSha2(SHA384, input, sizeof(input), output);
+  ErikSha2(CHACHA20, input, sizeof(input), output);
+  ErikSha2(SHA512, NULL, sizeof(input), output);
+  ErikSha2(SHA512, input, sizeof(input), NULL);
+  ErikChaCha20Encrypt(input, sizeof(input), key, nonce, 1, output);
+  ErikChaCha20Encrypt(input, sizeof(input), key, NULL, 1, output);
+  ErikChaCha20Encrypt(input, sizeof(input), key, nonce, 1, NULL);
+
+  if (CryptoStatsSnapshot(&snap)) {
+    fprintf(stderr, "ERROR - PROBE CHECK: build with CRYPTO_STATS=1.\n");
+    return 1;
+  }
+  for (op = 0; op < STAT_NUM_OPS; op++) {
+    samples = 0;
+    for (size = 0; size < STAT_SIZE_CLASSES; size++) {
+      for (bucket = 0; bucket < STAT_LATENCY_BUCKETS; bucket++) {
+        samples += snap.latency[op][size][bucket];
+      }
+    }
+    fprintf(stderr, "%s: %lu entries, %lu exits, %lu latency samples: ", opNames[op], probeEntries[op], probeExits[op], samples);
+    if (!probeEntries[op] || (probeEntries[op] != probeExits[op]) || (samples != probeExits[op])) {
+      fprintf(stderr, "FAILURE\n");
+      failures++;
+    } else {
+      fprintf(stderr, "SUCCESS\n");
+    }
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+/* Description: Snapshot side of the optional instrumentation declared in Crypto.h
+ *
+ * Every thread that touches a counter gets its own cryptoThreadStats linked
+ * into a global list, so the hot path never shares a cache line. A snapshot
+ * walks the list under a lock and sums it with the totals of threads that
+ * already exited.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Crypto.h"
+
+#define STAT_STRINGIFY(x)         #x
+#define STAT_XSTRINGIFY(x)        STAT_STRINGIFY(x)
+
+static const char *statCounterNames[STAT_NUM_COUNTERS] = {
+  // The multi-buffer width is fixed at build time, so its counter carries it
+  "sha256_calls", "sha256_bytes", "sha256_blocks", "sha256_blocks_x" STAT_XSTRINGIFY(SHA256_LANES), "sha2_calls",
+  "sha2_bytes", "sha512_blocks", "chacha20_calls", "chacha20_bytes", "chacha20_blocks_single",
+  "chacha20_blocks_portable", "chacha20_blocks_avx2", "chacha20_blocks_avx512", "rng_calls", "rng_bytes", "rng_refills",
+};
+
+static const char *statOpNames[STAT_NUM_OPS] = {"sha256", "sha2", "chacha20"};
+
+static const char *statSizeNames[STAT_SIZE_CLASSES] = {
+  "<64B", "<256B", "<1KB", "<4KB", "<16KB", "<64KB", "<256KB", ">=256KB",
+};
+
+#if CRYPTO_STATS
+__thread struct cryptoThreadStats *cryptoStatsLocal = NULL;
+
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t statsKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t statsKey;
+static struct cryptoThreadStats *statsHead = NULL;
+static struct cryptoStatsSnapshot statsRetired;
+
+// Function to add one set of stats into another, reading the source atomically
+static void AccumulateStats(struct cryptoStatsSnapshot *dest, struct cryptoStatsSnapshot *src) {
+  unsigned int ind;
+  uint64_t *destWords = (uint64_t *)dest, *srcWords = (uint64_t *)src;
+
+  for (ind = 0; ind < (sizeof(struct cryptoStatsSnapshot) / sizeof(uint64_t)); ind++) {
+    destWords[ind] += __atomic_load_n(&srcWords[ind], __ATOMIC_RELAXED);
+  }
+}
+
+// Thread exit destructor: fold the thread's stats into the retired totals
+static void CryptoStatsRetire(void *arg) {
+  struct cryptoThreadStats *local = arg;
+
+  pthread_mutex_lock(&statsLock);
+  AccumulateStats(&statsRetired, &local->stats);
+  if (local->prev) {
+    local->prev->next = local->next;
+  } else {
+    statsHead = local->next;
+  }
+  if (local->next) {
+    local->next->prev = local->prev;
+  }
+  pthread_mutex_unlock(&statsLock);
+  cryptoStatsLocal = NULL;
+  free(local);
+}
+
+static void CryptoStatsCreateKey(void) {
+  pthread_key_create(&statsKey, CryptoStatsRetire);
+}
+
+// Function to give the calling thread its own stats block on first use
+struct cryptoThreadStats *CryptoStatsRegister(void) {
+  struct cryptoThreadStats *local;
+
+  pthread_once(&statsKeyOnce, CryptoStatsCreateKey);
+  if (!(local = calloc(1, sizeof(struct cryptoThreadStats)))) {
+    return NULL;
+  }
+  pthread_mutex_lock(&statsLock);
+  local->next = statsHead;
+  if (statsHead) {
+    statsHead->prev = local;
+  }
+  statsHead = local;
+  pthread_mutex_unlock(&statsLock);
+  pthread_setspecific(statsKey, local);
+  cryptoStatsLocal = local;
+
+  return local;
+}
+
+// Function to sum the stats of every live and exited thread
+int CryptoStatsSnapshot(struct cryptoStatsSnapshot *snap) {
+  struct cryptoThreadStats *local;
+
+  if (!snap) {
+    return ERR_STATS_DISABLED;
+  }
+  pthread_mutex_lock(&statsLock);
+  memcpy(snap, &statsRetired, sizeof(struct cryptoStatsSnapshot));
+  for (local = statsHead; local; local = local->next) {
+    AccumulateStats(snap, &local->stats);
+  }
+  pthread_mutex_unlock(&statsLock);
+
+  return 0;
+}
+#else
+// Instrumentation compiled out: nothing to report
+int CryptoStatsSnapshot(struct cryptoStatsSnapshot *snap) {
+  if (snap) {
+    memset(snap, 0, sizeof(struct cryptoStatsSnapshot));
+  }
+  return ERR_STATS_DISABLED;
+}
+#endif
+
+/* Function to print a snapshot as "name value" lines. Histogram lines give the
+ * count of calls per power of two nanosecond bucket, e.g. "ns<2^10" for
+ * calls that took between 512 and 1023 ns.
+ */
+void CryptoStatsPrint(FILE *out, struct cryptoStatsSnapshot *snap) {
+  unsigned int ind, op, sizeClass, bucket;
+  uint64_t total;
+
+  for (ind = 0; ind < STAT_NUM_COUNTERS; ind++) {
+    fprintf(out, "%s %lu\n", statCounterNames[ind], (unsigned long)snap->counters[ind]);
+  }
+  for (op = 0; op < STAT_NUM_OPS; op++) {
+    for (sizeClass = 0; sizeClass < STAT_SIZE_CLASSES; sizeClass++) {
+      total = 0;
+      for (bucket = 0; bucket < STAT_LATENCY_BUCKETS; bucket++) {
+        total += snap->latency[op][sizeClass][bucket];
+      }
+      if (!total) {
+        continue;
+      }
+      fprintf(out, "%s_latency size%s count %lu:", statOpNames[op], statSizeNames[sizeClass], (unsigned long)total);
+      for (bucket = 0; bucket < STAT_LATENCY_BUCKETS; bucket++) {
+        if (snap->latency[op][sizeClass][bucket]) {
+          fprintf(out, " ns<2^%u=%lu", bucket+1, (unsigned long)snap->latency[op][sizeClass][bucket]);
+        }
+      }
+      fprintf(out, "\n");
+    }
+  }
+}
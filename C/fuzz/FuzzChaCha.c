@@ -0,0 +1,226 @@
+/* Description: Differential fuzz harness for ChaCha20 and ChaCha20-Poly1305
+ *
+ * ChaCha20Block, one block at a time, is the scalar reference keystream.
+ * Checked against it: the multi-block kernel through ChaCha20Blocks and
+ * ChaCha20KeyBlocks, every backend the CPU supports through
+ * ChaCha20KeyBlocksBackend, the gathered kernel with two keys interleaved at
+ * random, ErikChaCha20Encrypt out of place and in place on misaligned
+ * buffers, and ChaCha20KeyEncrypt resumed at a random block boundary. Counters come from
+ * the input, so wrap around is covered. Poly1305 is checked against the
+ * byte limb reference below and the AEAD against its RFC 8439 construction
+ * from the two references. Opening the reference ciphertext must round trip
+ * and a tag with one bit flipped must be rejected.
+ */
+
+#include "Crypto.h"
+#include "FuzzCommon.h"
+
+// Reference Poly1305 on 17 byte limbs, the TweetNaCl construction
+static void RefAdd1305(uint32_t h[17], const uint32_t c[17]) {
+  uint32_t ind, carry = 0;
+
+  for (ind = 0; ind < 17; ind++) {
+    carry += h[ind] + c[ind];
+    h[ind] = carry & 255;
+    carry >>= 8;
+  }
+}
+
+static void RefPoly1305(unsigned char *tag, const unsigned char *msg, size_t len, const unsigned char *key) {
+  static const uint32_t minusP[17] = {5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 252};
+  uint32_t r[17] = {0}, h[17] = {0}, c[17], g[17], x[17], carry, mask;
+  size_t take;
+  int i, j;
+
+  for (j = 0; j < 16; j++) {
+    r[j] = key[j];
+  }
+  r[3] &= 15; r[4] &= 252; r[7] &= 15; r[8] &= 252; r[11] &= 15; r[12] &= 252; r[15] &= 15;
+  while (len > 0) {
+    memset(c, 0, sizeof(c));
+    for (take = 0; (take < 16) && (take < len); take++) {
+      c[take] = msg[take];
+    }
+    c[take] = 1;
+    msg += take;
+    len -= take;
+    RefAdd1305(h, c);
+    for (i = 0; i < 17; i++) {
+      x[i] = 0;
+      for (j = 0; j < 17; j++) {
+        x[i] += h[j] * ((j <= i) ? r[i - j] : 320 * r[i + 17 - j]);
+      }
+    }
+    memcpy(h, x, sizeof(h));
+    carry = 0;
+    for (j = 0; j < 16; j++) {
+      carry += h[j];
+      h[j] = carry & 255;
+      carry >>= 8;
+    }
+    carry += h[16];
+    h[16] = carry & 3;
+    carry = 5 * (carry >> 2);
+    for (j = 0; j < 16; j++) {
+      carry += h[j];
+      h[j] = carry & 255;
+      carry >>= 8;
+    }
+    h[16] += carry;
+  }
+  memcpy(g, h, sizeof(g));
+  RefAdd1305(h, minusP);
+  mask = -(h[16] >> 7);
+  for (j = 0; j < 17; j++) {
+    h[j] ^= mask & (g[j] ^ h[j]);
+  }
+  for (j = 0; j < 16; j++) {
+    c[j] = key[j + 16];
+  }
+  c[16] = 0;
+  RefAdd1305(h, c);
+  for (j = 0; j < 16; j++) {
+    tag[j] = h[j];
+  }
+}
+
+// Function to build a reference keystream of numBlocks blocks one block at a time
+static void RefKeyStream(unsigned char *key, unsigned char *nonce, uint32_t counter, size_t numBlocks, unsigned char *out) {
+  size_t ind;
+
+  for (ind = 0; ind < numBlocks; ind++) {
+    ChaCha20Block(key, nonce, counter + ind, out + (ind * CHACHA_BLOCK_SIZE_BYTES));
+  }
+}
+
+// Function to check the AEAD against keystream block 0 as Poly1305 key and the padded MAC layout
+static void FuzzAead(unsigned char *key, unsigned char *nonce, unsigned char *msg, size_t len, size_t aadLen, unsigned char *refStream) {
+  size_t inLen = len - aadLen, macLen = ((aadLen + 15) & ~15UL) + ((inLen + 15) & ~15UL) + 16, ind;
+  unsigned char *aad = msg, *input = msg + aadLen, *out, *refOut, *macData;
+  unsigned char tag[POLY1305_TAG_SIZE_BYTES], refTag[POLY1305_TAG_SIZE_BYTES];
+
+  out = malloc(inLen + 1);
+  refOut = malloc(inLen + 1);
+  macData = calloc(macLen, 1);
+  if (!out || !refOut || !macData) {
+    abort();
+  }
+  RefKeyStream(key, nonce, 0, (inLen / CHACHA_BLOCK_SIZE_BYTES) + 2, refStream);
+  for (ind = 0; ind < inLen; ind++) {
+    refOut[ind] = input[ind] ^ refStream[CHACHA_BLOCK_SIZE_BYTES + ind];
+  }
+  memcpy(macData, aad, aadLen);
+  memcpy(macData + ((aadLen + 15) & ~15UL), refOut, inLen);
+  for (ind = 0; ind < 8; ind++) {
+    macData[macLen - 16 + ind] = ((uint64_t)aadLen >> (8*ind)) & 0xff;
+    macData[macLen - 8 + ind] = ((uint64_t)inLen >> (8*ind)) & 0xff;
+  }
+  RefPoly1305(refTag, macData, macLen, refStream);
+
+  FuzzCheck(!ErikChaCha20Poly1305Encrypt(input, inLen, aad, aadLen, key, nonce, out, tag), "aead return", len);
+  FuzzCheck(!memcmp(out, refOut, inLen) && !memcmp(tag, refTag, POLY1305_TAG_SIZE_BYTES), "aead output", len);
+  // Open must give the message back and reject the tag with any one bit flipped
+  FuzzCheck(!ErikChaCha20Poly1305Decrypt(refOut, inLen, aad, aadLen, key, nonce, out, refTag)
+            && !memcmp(out, input, inLen), "aead open", len);
+  refTag[len % POLY1305_TAG_SIZE_BYTES] ^= 1 << (len % 8);
+  FuzzCheck(ErikChaCha20Poly1305Decrypt(refOut, inLen, aad, aadLen, key, nonce, out, refTag) == ERR_POLY1305_AUTH,
+            "aead forged tag", len);
+  free(out);
+  free(refOut);
+  free(macData);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  struct fuzzInput in = {data, size, 0};
+  unsigned char key[CHACHA_KEY_SIZE_BYTES], otherKey[CHACHA_KEY_SIZE_BYTES], nonce[CHACHA_NONCE_SIZE_BYTES];
+  unsigned char polyKey[POLY1305_KEY_SIZE_BYTES], tag[POLY1305_TAG_SIZE_BYTES], refTag[POLY1305_TAG_SIZE_BYTES];
+  uint32_t counter, split, *counters;
+  unsigned int misalign;
+  unsigned char *base, *msg, *refStream, *stream, *out, **outputs;
+  const struct chacha20Key **gatherKeys;
+  struct chacha20Key chachaKey, otherChachaKey;
+  size_t len, numBlocks, ind, resumeBlocks;
+  int backend;
+
+  FuzzTakeBytes(&in, key, sizeof(key));
+  FuzzTakeBytes(&in, nonce, sizeof(nonce));
+  counter = FuzzTakeU32(&in);
+  misalign = FuzzTakeByte(&in);
+  split = FuzzTakeU32(&in) | 1;
+  msg = FuzzMisalignedCopy(&in, misalign, &base, &len);
+  numBlocks = (len + CHACHA_BLOCK_SIZE_BYTES - 1) / CHACHA_BLOCK_SIZE_BYTES;
+
+  refStream = malloc((numBlocks + 2) * CHACHA_BLOCK_SIZE_BYTES);
+  stream = malloc((numBlocks + 2) * CHACHA_BLOCK_SIZE_BYTES);
+  out = malloc(len + FUZZ_MAX_MISALIGN + 1);
+  outputs = malloc((numBlocks + 1) * sizeof(unsigned char *));
+  gatherKeys = malloc((numBlocks + 1) * sizeof(struct chacha20Key *));
+  counters = malloc((numBlocks + 1) * sizeof(uint32_t));
+  if (!refStream || !stream || !out || !outputs || !gatherKeys || !counters) {
+    abort();
+  }
+  RefKeyStream(key, nonce, counter, numBlocks, refStream);
+
+  ChaCha20Blocks(key, nonce, counter, numBlocks, stream);
+  FuzzCheck(!memcmp(refStream, stream, numBlocks * CHACHA_BLOCK_SIZE_BYTES), "chacha20 blocks", len);
+  ChaCha20KeyInit(&chachaKey, key, nonce);
+  ChaCha20KeyBlocks(&chachaKey, counter, numBlocks, stream);
+  FuzzCheck(!memcmp(refStream, stream, numBlocks * CHACHA_BLOCK_SIZE_BYTES), "chacha20 key blocks", len);
+  // Every multi-block kernel this CPU runs, not only the one dispatch picks
+  for (backend = CHACHA_BACKEND_PORTABLE; backend <= CHACHA_BACKEND_AVX512; backend++) {
+    if (ChaCha20BackendLanes(backend)) {
+      FuzzCheck(!ChaCha20KeyBlocksBackend(&chachaKey, counter, numBlocks, stream, backend), "chacha20 backend return", len);
+      FuzzCheck(!memcmp(refStream, stream, numBlocks * CHACHA_BLOCK_SIZE_BYTES), "chacha20 backend blocks", len);
+    }
+  }
+
+  // Gather with a second key on random blocks, each checked against its own reference block
+  for (ind = 0; ind < sizeof(otherKey); ind++) {
+    otherKey[ind] = key[ind] ^ 0x5a;
+  }
+  ChaCha20KeyInit(&otherChachaKey, otherKey, nonce);
+  for (ind = 0; ind < numBlocks; ind++) {
+    gatherKeys[ind] = (FuzzNextSplit(&split) & 1) ? &otherChachaKey : &chachaKey;
+    counters[ind] = counter + (FuzzNextSplit(&split) % 4);
+    outputs[ind] = stream + (ind * CHACHA_BLOCK_SIZE_BYTES);
+  }
+  ChaCha20BlocksGather(gatherKeys, counters, numBlocks, outputs);
+  for (ind = 0; ind < numBlocks; ind++) {
+    ChaCha20Block((gatherKeys[ind] == &chachaKey) ? key : otherKey, nonce, counters[ind], refStream + (numBlocks * CHACHA_BLOCK_SIZE_BYTES));
+    FuzzCheck(!memcmp(refStream + (numBlocks * CHACHA_BLOCK_SIZE_BYTES), outputs[ind], CHACHA_BLOCK_SIZE_BYTES), "chacha20 gather", len);
+  }
+
+  // Encrypt out of place to a differently misaligned buffer, then in place
+  if (len) {
+    FuzzCheck(!ErikChaCha20Encrypt(msg, len, key, nonce, counter, out + (split % FUZZ_MAX_MISALIGN)), "encrypt return", len);
+    for (ind = 0; ind < len; ind++) {
+      FuzzCheck(out[(split % FUZZ_MAX_MISALIGN) + ind] == (msg[ind] ^ refStream[ind]), "encrypt output", len);
+    }
+    memcpy(out, msg, len);
+    ErikChaCha20Encrypt(out, len, key, nonce, counter, out);
+    for (ind = 0; ind < len; ind++) {
+      FuzzCheck(out[ind] == (msg[ind] ^ refStream[ind]), "encrypt in place", len);
+    }
+  }
+  // Key object encrypt stopped and resumed at a block boundary
+  resumeBlocks = FuzzNextSplit(&split) % (numBlocks + 1);
+  resumeBlocks = ((resumeBlocks * CHACHA_BLOCK_SIZE_BYTES) > len) ? (len / CHACHA_BLOCK_SIZE_BYTES) : resumeBlocks;
+  ChaCha20KeyEncrypt(&chachaKey, msg, resumeBlocks * CHACHA_BLOCK_SIZE_BYTES, counter, out);
+  ChaCha20KeyEncrypt(&chachaKey, msg + (resumeBlocks * CHACHA_BLOCK_SIZE_BYTES), len - (resumeBlocks * CHACHA_BLOCK_SIZE_BYTES),
+                     counter + resumeBlocks, out + (resumeBlocks * CHACHA_BLOCK_SIZE_BYTES));
+  for (ind = 0; ind < len; ind++) {
+    FuzzCheck(out[ind] == (msg[ind] ^ refStream[ind]), "key encrypt resumed", len);
+  }
+
+  // Poly1305 with a key taken from the parameters, unclamped bits included
+  memcpy(polyKey, key, CHACHA_KEY_SIZE_BYTES);
+  ErikGenPoly1305(msg, len, polyKey, tag);
+  RefPoly1305(refTag, msg, len, polyKey);
+  FuzzCheck(!memcmp(tag, refTag, POLY1305_TAG_SIZE_BYTES), "poly1305", len);
+
+  FuzzAead(key, nonce, msg, len, len ? (FuzzNextSplit(&split) % (len + 1)) : 0, refStream);
+
+  free(refStream); free(stream); free(out); free(outputs); free(gatherKeys); free(counters);
+  free(base);
+  return 0;
+}
@@ -0,0 +1,79 @@
+/* Description: Shared helpers for the differential fuzz harnesses
+ *
+ * Every harness is a libFuzzer style LLVMFuzzerTestOneInput. The first bytes
+ * of an input pick the parameters (key, alignment, split pattern, ...) and
+ * the rest is the message. Any difference from the scalar reference prints
+ * the failing check and aborts, so libFuzzer, AFL++ and FuzzMain.c all treat
+ * it as a crash.
+ */
+
+#ifndef __FUZZ_COMMON__
+#define __FUZZ_COMMON__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Inputs are copied this far past a 64B boundary to vary the alignment
+#define FUZZ_MAX_MISALIGN         64
+
+struct fuzzInput {
+  const uint8_t *data;
+  size_t size;
+  size_t pos;
+};
+
+// Function to take one parameter byte, zero once the input runs out
+static inline uint8_t FuzzTakeByte(struct fuzzInput *in) {
+  return (in->pos < in->size) ? in->data[in->pos++] : 0;
+}
+
+static inline uint32_t FuzzTakeU32(struct fuzzInput *in) {
+  uint32_t val = 0;
+  int ind;
+
+  for (ind = 0; ind < 4; ind++) {
+    val |= (uint32_t)FuzzTakeByte(in) << (8*ind);
+  }
+  return val;
+}
+
+// Function to fill out with len parameter bytes, zero padded once the input runs out
+static inline void FuzzTakeBytes(struct fuzzInput *in, unsigned char *out, size_t len) {
+  size_t ind;
+
+  for (ind = 0; ind < len; ind++) {
+    out[ind] = FuzzTakeByte(in);
+  }
+}
+
+// xorshift32 stream that turns one seed byte into a split pattern
+static inline uint32_t FuzzNextSplit(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/* Function to copy the rest of the input to a buffer misaligned by
+ * misalign bytes from a 64B boundary. *base is what has to be freed.
+ */
+static inline unsigned char *FuzzMisalignedCopy(struct fuzzInput *in, unsigned int misalign, unsigned char **base, size_t *len) {
+  *len = in->size - in->pos;
+  if (posix_memalign((void **)base, 64, *len + FUZZ_MAX_MISALIGN + 1)) {
+    abort();
+  }
+  memcpy(*base + (misalign % FUZZ_MAX_MISALIGN), in->data + in->pos, *len);
+  in->pos = in->size;
+  return *base + (misalign % FUZZ_MAX_MISALIGN);
+}
+
+static inline void FuzzCheck(int ok, const char *what, size_t len) {
+  if (!ok) {
+    fprintf(stderr, "FUZZ MISMATCH - %s, message length %zu\n", what, len);
+    abort();
+  }
+}
+
+#endif
@@ -0,0 +1,151 @@
+/* Description: Standalone driver for the fuzz harnesses
+ *
+ * Links against any harness in place of libFuzzer so it can run where clang
+ * is not available, e.g. the gcc sanitizer build of make fuzz-check:
+ *   <harness> [-n iterations] [-l maxLen] [-s seed] [file or directory ...]
+ * Files and directories are replayed, e.g. a corpus or a crash. Without them
+ * random inputs are generated from the seed. Built with afl-clang-fast it
+ * runs AFL++ persistent mode instead.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+__AFL_FUZZ_INIT();
+#endif
+
+// Function to run one input file through the harness
+static int FuzzRunFile(const char *path) {
+  unsigned char *data;
+  long size;
+  FILE *file;
+
+  if (!(file = fopen(path, "rb"))) {
+    fprintf(stderr, "ERROR - FUZZ: unable to open %s.\n", path);
+    return 1;
+  }
+  fseek(file, 0, SEEK_END);
+  size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (!(data = malloc(size + 1)) || (fread(data, 1, size, file) != (size_t)size)) {
+    fprintf(stderr, "ERROR - FUZZ: unable to read %s.\n", path);
+    free(data);
+    fclose(file);
+    return 1;
+  }
+  fclose(file);
+  LLVMFuzzerTestOneInput(data, size);
+  free(data);
+  return 0;
+}
+
+// Function to replay a file or every file of a directory, returns the inputs run
+static unsigned long FuzzRunPath(const char *path) {
+  char child[4096];
+  struct dirent *entry;
+  struct stat st;
+  unsigned long count = 0;
+  DIR *dir;
+
+  if (stat(path, &st) || !S_ISDIR(st.st_mode)) {
+    return FuzzRunFile(path) ? 0 : 1;
+  }
+  if (!(dir = opendir(path))) {
+    return 0;
+  }
+  while ((entry = readdir(dir))) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+    count += FuzzRunPath(child);
+  }
+  closedir(dir);
+  return count;
+}
+
+// xorshift64* generator for the random inputs
+static uint64_t FuzzRand(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545f4914f6cdd1dULL;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long iterations = 10000, maxLen = 4096, ind, pos, len, count = 0, bytes = 0;
+  uint64_t seed = 1;
+  unsigned char *data;
+  struct timespec start, now;
+  double secs;
+  int c;
+
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+  if (argc == 1) {
+    __AFL_INIT();
+    data = __AFL_FUZZ_TESTCASE_BUF;
+    while (__AFL_LOOP(10000)) {
+      LLVMFuzzerTestOneInput(data, __AFL_FUZZ_TESTCASE_LEN);
+    }
+    return 0;
+  }
+#endif
+  while ((c = getopt(argc, argv, "n:l:s:")) != -1) {
+    switch (c) {
+      case 'n':
+        iterations = strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        maxLen = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 10) | 1;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n iterations] [-l maxLen] [-s seed] [file or directory ...]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (optind < argc) {
+    for (; optind < argc; optind++) {
+      count += FuzzRunPath(argv[optind]);
+    }
+  } else {
+    if (!(data = malloc(maxLen + 1))) {
+      return 1;
+    }
+    for (ind = 0; ind < iterations; ind++) {
+      // Half the inputs stay within a few blocks, where the tail handling lives
+      len = FuzzRand(&seed) % (((ind & 1) ? maxLen : 300) + 1);
+      for (pos = 0; pos < len; pos++) {
+        data[pos] = FuzzRand(&seed) >> 56;
+      }
+      // Some inputs repeat a pattern so the chunker finds duplicate content
+      if (len && !(ind % 5)) {
+        for (pos = len / 2; pos < len; pos++) {
+          data[pos] = data[pos - (len / 2)];
+        }
+      }
+      LLVMFuzzerTestOneInput(data, len);
+      bytes += len;
+      count++;
+    }
+    free(data);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  secs = (now.tv_sec - start.tv_sec) + ((now.tv_nsec - start.tv_nsec) / 1e9);
+  fprintf(stderr, "%s: %lu inputs, %lu random bytes in %.2f s, %.0f execs/s\n", argv[0], count, bytes, secs, secs > 0 ? count / secs : 0.0);
+
+  return 0;
+}
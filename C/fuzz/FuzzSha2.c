@@ -0,0 +1,250 @@
+/* Description: Differential fuzz harness for the SHA2 family
+ *
+ * The one shot ErikSha256 is the scalar reference for SHA256. Checked
+ * against it: streaming with a random split pattern, midstate export and
+ * import, the prefix cache on a miss and a hit, the SHA2 dispatcher, the
+ * multi-buffer path with a random set of messages and the content defined
+ * chunker on one thread and on two to nine. For the other SHA2 variants
+ * streaming is checked against one shot ErikSha2, and SHA384, SHA512 and
+ * SHA512/256 are also checked against the straight-line reference below,
+ * which shares no code with sha512.c or the sha2.c core.
+ */
+
+#include "Crypto.h"
+#include "FuzzCommon.h"
+
+static const enum algorithm fuzzAlgs[] = {SHA256, SHA224, SHA384, SHA512, SHA512_256};
+
+static const uint64_t refK512[80] = {
+  0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+  0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+  0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+  0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+  0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+  0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+  0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+  0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+  0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+  0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+  0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+  0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+  0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+  0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+  0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+  0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+  0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+  0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+  0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+  0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+#define REF_ROTR64(x, n)          (((x) >> (n)) | ((x) << (64 - (n))))
+
+// Function to compress one 128 byte block into state, straight from FIPS 180-4 section 6.4
+static void RefCompressSha512(uint64_t *state, const unsigned char *block) {
+  uint64_t w[80], a, b, c, d, e, f, g, h, t1, t2;
+  unsigned int ind, byte;
+
+  for (ind = 0; ind < 16; ind++) {
+    w[ind] = 0;
+    for (byte = 0; byte < 8; byte++) {
+      w[ind] = (w[ind] << 8) | block[(ind * 8) + byte];
+    }
+  }
+  for (ind = 16; ind < 80; ind++) {
+    w[ind] = (REF_ROTR64(w[ind-2], 19) ^ REF_ROTR64(w[ind-2], 61) ^ (w[ind-2] >> 6)) + w[ind-7]
+           + (REF_ROTR64(w[ind-15], 1) ^ REF_ROTR64(w[ind-15], 8) ^ (w[ind-15] >> 7)) + w[ind-16];
+  }
+  a = state[0]; b = state[1]; c = state[2]; d = state[3];
+  e = state[4]; f = state[5]; g = state[6]; h = state[7];
+  for (ind = 0; ind < 80; ind++) {
+    t1 = h + (REF_ROTR64(e, 14) ^ REF_ROTR64(e, 18) ^ REF_ROTR64(e, 41)) + ((e & f) ^ (~e & g)) + refK512[ind] + w[ind];
+    t2 = (REF_ROTR64(a, 28) ^ REF_ROTR64(a, 34) ^ REF_ROTR64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+  state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// Function to hash msg with the reference SHA512 family, returns the digest length or 0 for other algorithms
+static size_t RefSha512Family(enum algorithm alg, const unsigned char *msg, size_t len, unsigned char *out) {
+  static const uint64_t iv384[8] = {
+    0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL, 0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+    0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL, 0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL
+  };
+  static const uint64_t iv512[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+  };
+  static const uint64_t iv512_256[8] = {
+    0x22312194fc2bf72cULL, 0x9f555fa3c84c64c2ULL, 0x2393b86b6f53b151ULL, 0x963877195940eabdULL,
+    0x96283ee2a88effe3ULL, 0xbe5e1e2553863992ULL, 0x2b0199fc2c85b8aaULL, 0x0eb72ddc81c52ca2ULL
+  };
+  unsigned char tail[256];
+  uint64_t state[8];
+  size_t outLen, done, tailLen, ind;
+
+  switch (alg) {
+    case SHA384: memcpy(state, iv384, sizeof(state)); outLen = 48; break;
+    case SHA512: memcpy(state, iv512, sizeof(state)); outLen = 64; break;
+    case SHA512_256: memcpy(state, iv512_256, sizeof(state)); outLen = 32; break;
+    default: return 0;
+  }
+  for (done = 0; (len - done) >= 128; done += 128) {
+    RefCompressSha512(state, msg + done);
+  }
+  // 0x80, zeros, then the 128 bit big endian bit length, in one or two blocks
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, msg + done, len - done);
+  tail[len - done] = 0x80;
+  tailLen = ((len - done) < 112) ? 128 : 256;
+  for (ind = 0; ind < 8; ind++) {
+    tail[tailLen - 1 - ind] = (unsigned char)(((uint64_t)len << 3) >> (8 * ind));
+  }
+  tail[tailLen - 9] = (unsigned char)((uint64_t)len >> 61);
+  for (ind = 0; ind < tailLen; ind += 128) {
+    RefCompressSha512(state, tail + ind);
+  }
+  for (ind = 0; ind < outLen; ind++) {
+    out[ind] = (unsigned char)(state[ind / 8] >> (56 - (8 * (ind % 8))));
+  }
+
+  return outLen;
+}
+
+// Function to hash msg through the streaming API in pieces picked by split
+static void FuzzStreamSha2(enum algorithm alg, unsigned char *msg, size_t len, uint32_t split, unsigned char *out) {
+  struct sha2Ctx ctx;
+  size_t pos = 0, piece;
+
+  Sha2Init(&ctx, alg);
+  while (pos < len) {
+    // Mostly short pieces around block boundaries, sometimes everything left
+    piece = FuzzNextSplit(&split) % 300;
+    if (!(split & 0x700)) {
+      piece = len - pos;
+    }
+    piece = (piece < (len - pos)) ? piece : (len - pos);
+    Sha2Update(&ctx, msg+pos, piece);
+    pos += piece;
+  }
+  Sha2Final(&ctx, out);
+}
+
+// Function to check every chunk of a chunked message and the thread counts against each other.
+// Small max sizes give the threaded path several regions to resync even on short inputs.
+static void FuzzCdc(unsigned char *msg, size_t len, uint8_t pick) {
+  unsigned long minSize = CDC_WINDOW_BYTES + ((pick & 3) * 64), maxSize = minSize * ((pick & 4) ? 16 : 3);
+  unsigned long numOne = 0, numMany = 0, ind;
+  unsigned int numThreads = 2 + ((pick >> 3) & 7);
+  unsigned char expected[SHA256_OUTPUT_BYTES];
+  struct cdcChunk *one = NULL, *many = NULL;
+
+  if (ErikCdcChunkBuffer(msg, len, minSize, minSize*2, maxSize, 1, &one, &numOne)
+      || ErikCdcChunkBuffer(msg, len, minSize, minSize*2, maxSize, numThreads, &many, &numMany)) {
+    FuzzCheck(0, "cdc chunk buffer", len);
+  }
+  FuzzCheck((numOne == numMany) && !memcmp(one, many, numOne * sizeof(struct cdcChunk)), "cdc thread counts", len);
+  for (ind = 0; ind < numOne; ind++) {
+    FuzzCheck(one[ind].offset == (ind ? one[ind-1].offset + one[ind-1].len : 0), "cdc chunk offsets", len);
+    FuzzCheck((one[ind].len <= maxSize) && ((one[ind].len >= minSize) || (ind == numOne-1)), "cdc chunk sizes", len);
+    ErikSha256(msg+one[ind].offset, one[ind].len*8, expected);
+    FuzzCheck(!memcmp(expected, one[ind].digest, SHA256_OUTPUT_BYTES), "cdc chunk digest", len);
+  }
+  FuzzCheck(!numOne || ((one[numOne-1].offset + one[numOne-1].len) == len), "cdc coverage", len);
+  free(one);
+  free(many);
+}
+
+// Function to hash a random set of sub-messages with the multi-buffer path
+static void FuzzMultiBuffer(unsigned char *msg, size_t len, uint32_t split) {
+  unsigned char *inputs[(2*SHA256_LANES)+1], *outputs[(2*SHA256_LANES)+1];
+  unsigned char digests[(2*SHA256_LANES)+1][SHA256_OUTPUT_BYTES], expected[SHA256_OUTPUT_BYTES];
+  unsigned long inLens[(2*SHA256_LANES)+1], start;
+  unsigned int count = 1 + (FuzzNextSplit(&split) % ((2*SHA256_LANES)+1)), ind;
+
+  for (ind = 0; ind < count; ind++) {
+    // The first message is the whole input, the others random slices of it
+    start = (ind && len) ? (FuzzNextSplit(&split) % (len + 1)) : 0;
+    inputs[ind] = msg + start;
+    inLens[ind] = ind ? (FuzzNextSplit(&split) % (len - start + 1)) : len;
+    outputs[ind] = digests[ind];
+  }
+  FuzzCheck(!Sha256MultiBuffer(inputs, inLens, count, outputs), "multi-buffer return", len);
+  for (ind = 0; ind < count; ind++) {
+    ErikSha256(inputs[ind], inLens[ind]*8, expected);
+    FuzzCheck(!memcmp(expected, digests[ind], SHA256_OUTPUT_BYTES), "multi-buffer digest", inLens[ind]);
+  }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static struct sha256PrefixCache *cache;
+  static unsigned long prefixKey;
+  struct fuzzInput in = {data, size, 0};
+  enum algorithm alg = fuzzAlgs[FuzzTakeByte(&in) % 5];
+  unsigned int misalign = FuzzTakeByte(&in);
+  uint8_t cdcPick = FuzzTakeByte(&in);
+  uint32_t split = FuzzTakeU32(&in) | 1;
+  unsigned char expected[SHA2_MAX_OUTPUT_BYTES], output[SHA2_MAX_OUTPUT_BYTES];
+  unsigned char *base, *msg;
+  unsigned long blockBytes, prefixLen;
+  struct sha256Ctx ctx, resumed;
+  struct sha256Midstate mid;
+  size_t len;
+  int ind;
+
+  msg = FuzzMisalignedCopy(&in, misalign, &base, &len);
+  if (!cache) {
+    cache = Sha256PrefixCacheCreate(4);
+  }
+
+  if (alg != SHA256) {
+    ErikSha2(alg, msg, len, expected);
+    FuzzStreamSha2(alg, msg, len, split, output);
+    FuzzCheck(!memcmp(expected, output, Sha2OutputBytes(alg)), "sha2 streaming split", len);
+    if (RefSha512Family(alg, msg, len, output)) {
+      FuzzCheck(!memcmp(expected, output, Sha2OutputBytes(alg)), "sha512 family reference", len);
+    }
+    free(base);
+    return 0;
+  }
+
+  ErikSha256(msg, len*8, expected);
+  FuzzStreamSha2(SHA256, msg, len, split, output);
+  FuzzCheck(!memcmp(expected, output, SHA256_OUTPUT_BYTES), "sha256 streaming split", len);
+  ErikSha2(SHA256, msg, len, output);
+  FuzzCheck(!memcmp(expected, output, SHA256_OUTPUT_BYTES), "sha2 dispatcher", len);
+
+  // Resume from an exported midstate at a random block boundary
+  blockBytes = (len / SHA256_BLOCK_SIZE_BYTES) ? (FuzzNextSplit(&split) % ((len / SHA256_BLOCK_SIZE_BYTES) + 1)) * SHA256_BLOCK_SIZE_BYTES : 0;
+  Sha256Init(&ctx);
+  Sha256Update(&ctx, msg, blockBytes);
+  FuzzCheck(!Sha256ExportMidstate(&ctx, &mid), "midstate export", len);
+  Sha256Init(&resumed);
+  FuzzCheck(!Sha256ImportMidstate(&resumed, &mid), "midstate import", len);
+  Sha256Update(&resumed, msg+blockBytes, len-blockBytes);
+  Sha256Final(&resumed, output);
+  FuzzCheck(!memcmp(expected, output, SHA256_OUTPUT_BYTES), "midstate resume", len);
+
+  // Prefix cache miss, then hit, then no cache
+  prefixLen = FuzzNextSplit(&split) % (len + 1);
+  for (ind = 0; ind < 2; ind++) {
+    ErikSha256Prefixed(cache, msg, prefixLen, msg+prefixLen, len-prefixLen, output);
+    FuzzCheck(!memcmp(expected, output, SHA256_OUTPUT_BYTES), "prefix cache", len);
+  }
+  ErikSha256Prefixed(NULL, msg, prefixLen, msg+prefixLen, len-prefixLen, output);
+  FuzzCheck(!memcmp(expected, output, SHA256_OUTPUT_BYTES), "prefix without cache", len);
+  // Keyed lookup, a new key per input since the cache outlives it
+  prefixKey++;
+  for (ind = 0; ind < 2; ind++) {
+    ErikSha256PrefixedKey(cache, prefixKey, msg, prefixLen, msg+prefixLen, len-prefixLen, output);
+    FuzzCheck(!memcmp(expected, output, SHA256_OUTPUT_BYTES), "prefix cache keyed", len);
+  }
+
+  FuzzMultiBuffer(msg, len, split);
+  FuzzCdc(msg, len, cdcPick);
+
+  free(base);
+  return 0;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Description: Minimize a fuzz corpus for throughput
+#
+# Usage: fuzz/MinimizeCorpus.sh <FuzzSha2|FuzzChaCha>[_avx2|_avx512] <corpus dir> [max_len]
+#
+# Writes <corpus dir>-min holding, for every coverage feature, the smallest
+# and fastest input that reaches it. libFuzzer -merge=1 (make fuzz) prefers
+# the shortest input per feature. afl-cmin (make fuzz-afl) is used when only
+# the AFL++ build exists. Inputs longer than max_len or slower than TIMEOUT_MS
+# are dropped, since the long ones mostly repeat full block work without new
+# coverage. Fuzz afterwards with the same -max_len to keep execs/s up. If the
+# make fuzz-check build exists both corpora are replayed through it to show
+# the execs/s before and after.
+
+set -e
+
+TARGET=${1:?usage: $0 <FuzzSha2|FuzzChaCha>[_avx2|_avx512] <corpus dir> [max_len]}
+CORPUS=${2:?usage: $0 <FuzzSha2|FuzzChaCha>[_avx2|_avx512] <corpus dir> [max_len]}
+MAX_LEN=${3:-4096}
+TIMEOUT_MS=${TIMEOUT_MS:-200}
+FUZZ_DIR=$(dirname "$0")
+OUT="${CORPUS%/}-min"
+
+mkdir -p "$OUT"
+if [ -x "$FUZZ_DIR/$TARGET" ]; then
+  "$FUZZ_DIR/$TARGET" -merge=1 -max_len="$MAX_LEN" -timeout=$(( (TIMEOUT_MS + 999) / 1000 )) "$OUT" "$CORPUS"
+elif [ -x "$FUZZ_DIR/$TARGET.afl" ] && command -v afl-cmin > /dev/null; then
+  afl-cmin -i "$CORPUS" -o "$OUT" -t "$TIMEOUT_MS" -- "$FUZZ_DIR/$TARGET.afl" @@
+else
+  echo "ERROR - no $FUZZ_DIR/$TARGET or $FUZZ_DIR/$TARGET.afl, run make fuzz or make fuzz-afl first." >&2
+  exit 1
+fi
+# afl-cmin has no length limit of its own
+find "$OUT" -type f -size +"$MAX_LEN"c -delete
+
+echo "$(ls "$CORPUS" | wc -l) inputs, $(du -sk "$CORPUS" | cut -f1) KB -> $(ls "$OUT" | wc -l) inputs, $(du -sk "$OUT" | cut -f1) KB"
+if [ -x "$FUZZ_DIR/$TARGET.check" ]; then
+  "$FUZZ_DIR/$TARGET.check" "$CORPUS"
+  "$FUZZ_DIR/$TARGET.check" "$OUT"
+fi
@@ -0,0 +1,15 @@
+/* Description: Stand-in for systemtap's <sys/sdt.h>, used by make probe-check
+ *
+ * Crypto.h only emits USDT probes when <sys/sdt.h> exists. This stub lets the
+ * CRYPTO_STATS=1 probe path compile without systemtap. Every probe site calls
+ * CryptoProbeHit, which ProbeCheck.c defines to count entries and exits.
+ */
+
+#ifndef __CRYPTO_SDT_STUB__
+#define __CRYPTO_SDT_STUB__
+
+void CryptoProbeHit(const char *probe, long op, long len);
+
+#define DTRACE_PROBE2(provider, probe, arg1, arg2)  CryptoProbeHit(#probe, (long)(arg1), (long)(arg2))
+
+#endif
@@ -0,0 +1,159 @@
+/* Description: SHA2 family front end. Dispatches one streaming API onto the
+ *              SHA256 core (SHA224, SHA256) or the SHA512 core (SHA384,
+ *              SHA512, SHA512/256) and truncates the output. Also holds the
+ *              block buffering and padding both cores stream through.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Crypto.h"
+
+/* Shared streaming core: absorb inLen bytes into a partial block of
+ * core->blockBytes, compressing every completed block straight from input
+ * where possible.
+ */
+void Sha2CoreUpdate(const struct sha2Core *core, void *hash, unsigned long *numBlocks, unsigned char *block,
+                    unsigned int *blockLen, unsigned char *input, unsigned long inLen) {
+  unsigned long take;
+
+  if (!inLen) {
+    return;
+  }
+  if (*blockLen) {
+    take = core->blockBytes - *blockLen;
+    if (take > inLen) {
+      take = inLen;
+    }
+    memcpy(block+*blockLen, input, take);
+    *blockLen += take;
+    input += take;
+    inLen -= take;
+    if (*blockLen < core->blockBytes) {
+      return;
+    }
+    core->compress(hash, block, 1);
+    (*numBlocks)++;
+    *blockLen = 0;
+  }
+  take = inLen / core->blockBytes;
+  if (take) {
+    core->compress(hash, input, take);
+    *numBlocks += take;
+  }
+  take *= core->blockBytes;
+  memcpy(block, input+take, inLen-take);
+  *blockLen = inLen-take;
+}
+
+/* Shared streaming core: pad the buffered tail with 0x80, zeroes and the
+ * big-endian bit length in the last core->lenBytes bytes, then compress.
+ * The caller serializes the chaining state.
+ */
+void Sha2CoreFinal(const struct sha2Core *core, void *hash, unsigned long numBlocks, unsigned char *block, unsigned int blockLen) {
+  unsigned long lenBytes = (numBlocks * core->blockBytes) + blockLen;
+  unsigned int index;
+
+  block[blockLen++] = 0x80;
+  if (blockLen > (core->blockBytes - core->lenBytes)) {
+    memset(block+blockLen, 0, core->blockBytes - blockLen);
+    core->compress(hash, block, 1);
+    blockLen = 0;
+  }
+  memset(block+blockLen, 0, core->blockBytes - blockLen);
+  for (index = 0; index < 8; index++) {
+    block[core->blockBytes-1-index] = (lenBytes << 3) >> (index*8);
+  }
+  // 128b length fields only hold the bits shifted out of lenBytes in their upper word
+  if (core->lenBytes > 8) {
+    block[core->blockBytes-9] = lenBytes >> 61;
+  }
+  core->compress(hash, block, 1);
+}
+
+// Function returning the digest size of a SHA2 variant, 0 if unknown
+unsigned int Sha2OutputBytes(enum algorithm alg) {
+  switch (alg) {
+  case SHA224:
+    return SHA224_OUTPUT_BYTES;
+  case SHA256:
+    return SHA256_OUTPUT_BYTES;
+  case SHA384:
+    return SHA384_OUTPUT_BYTES;
+  case SHA512:
+    return SHA512_OUTPUT_BYTES;
+  case SHA512_256:
+    return SHA512_256_OUTPUT_BYTES;
+  default:
+    return 0;
+  }
+}
+
+// Streaming SHA2: reset a context for the given variant
+int Sha2Init(struct sha2Ctx *ctx, enum algorithm alg) {
+  if (!ctx) {
+    fprintf(stderr, "ERROR - SHA2: NULL context passed to Sha2Init.\n");
+    return ERR_SHA2_ALGORITHM;
+  }
+  ctx->alg = alg;
+  switch (alg) {
+  case SHA224:
+    Sha224Init(&ctx->u.ctx256);
+    return 0;
+  case SHA256:
+    Sha256Init(&ctx->u.ctx256);
+    return 0;
+  default:
+    return Sha512Init(&ctx->u.ctx512, alg);
+  }
+}
+
+// Streaming SHA2: absorb inLen bytes
+int Sha2Update(struct sha2Ctx *ctx, unsigned char *input, unsigned long inLen) {
+  if ((ctx->alg == SHA224) || (ctx->alg == SHA256)) {
+    return Sha256Update(&ctx->u.ctx256, input, inLen);
+  }
+  return Sha512Update(&ctx->u.ctx512, input, inLen);
+}
+
+// Streaming SHA2: write Sha2OutputBytes(ctx->alg) bytes of digest
+int Sha2Final(struct sha2Ctx *ctx, unsigned char *outBuff) {
+  unsigned char fullOutput[SHA2_MAX_OUTPUT_BYTES];
+  int ret;
+
+  if (!outBuff) {
+    fprintf(stderr, "ERROR - SHA2: NULL output buffer passed to Sha2Final.\n");
+    return ERR_SHA2_ALGORITHM;
+  }
+  if ((ctx->alg == SHA224) || (ctx->alg == SHA256)) {
+    ret = Sha256Final(&ctx->u.ctx256, fullOutput);
+  } else {
+    ret = Sha512Final(&ctx->u.ctx512, fullOutput);
+  }
+  if (!ret) {
+    memcpy(outBuff, fullOutput, Sha2OutputBytes(ctx->alg));
+  }
+
+  return ret;
+}
+
+// One shot SHA2 of a byte buffer
+int ErikSha2(enum algorithm alg, unsigned char *inBuff, unsigned long inLen, unsigned char *outBuff) {
+  struct sha2Ctx ctx;
+  int ret;
+
+  if (!Sha2OutputBytes(alg) || (!inBuff && inLen) || !outBuff) {
+    fprintf(stderr, "ERROR - SHA2: invalid algorithm, input or output buffer passed to ErikSha2.\n");
+    return ERR_SHA2_ALGORITHM;
+  }
+  CRYPTO_STAT_BEGIN(STAT_OP_SHA2, inLen);
+  CRYPTO_STAT_ADD(STAT_SHA2_CALLS, 1);
+  CRYPTO_STAT_ADD(STAT_SHA2_BYTES, inLen);
+  if (!(ret = Sha2Init(&ctx, alg)) && !(ret = Sha2Update(&ctx, inBuff, inLen))) {
+    ret = Sha2Final(&ctx, outBuff);
+  }
+  CRYPTO_STAT_END(STAT_OP_SHA2, inLen);
+
+  return ret;
+}
@@ -10,12 +10,14 @@
 
 #include "Crypto.h"
 
-#define DEBUG 0
-
 // Sha256 initial hash values
 static unsigned int initHashSha256[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 
                                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
-                                         
+
+// Sha224 initial hash values
+static unsigned int initHashSha224[8] = {0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939,
+                                         0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4};
+
 // Sha256 constants needed for functionality
 static unsigned int constantWordsSha256[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 
                                             0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
@@ -44,16 +46,25 @@ int ErikSha256(unsigned char *inBuff, unsigned long inLenBits, unsigned char *ou
     unsigned int messageSchedule[64] = {0};
     unsigned char *input;
 
-    input = calloc((inLenBits/8)+1, sizeof(unsigned char));
-    memcpy(input, inBuff, (inLenBits/8));
-    if (!outBuff) {
-        fprintf(stderr, "ERROR - SHA256: invalid output buffer provided to function. Must be %d bytes.\n", SHA256_OUTPUT_BYTES);
-        free(input); input = NULL;
+    if (!outBuff || (!inBuff && (inLenBits / 8))) {
+        fprintf(stderr, "ERROR - SHA256: invalid input or output buffer provided to function. Output must be %d bytes.\n", SHA256_OUTPUT_BYTES);
         return ERR_SHA256_MAIN;
     }
+    CRYPTO_STAT_BEGIN(STAT_OP_SHA256, inLenBits / 8);
+    CRYPTO_STAT_ADD(STAT_SHA256_CALLS, 1);
+    CRYPTO_STAT_ADD(STAT_SHA256_BYTES, inLenBits / 8);
+    if (!(input = calloc((inLenBits/8)+1, sizeof(unsigned char)))) {
+        fprintf(stderr, "ERROR - SHA256: unable to allocate memory for the input copy.\n");
+        CRYPTO_STAT_END(STAT_OP_SHA256, inLenBits / 8);
+        return ERR_ALLOC;
+    }
+    if (inLenBits / 8) {
+        memcpy(input, inBuff, (inLenBits/8));
+    }
     if (PadInputSha256(&input, &currInputLenBits)) {
         fprintf(stderr, "SHA256 function not completed. Returning...\n");
         free(input); input = NULL;
+        CRYPTO_STAT_END(STAT_OP_SHA256, inLenBits / 8);
         return ERR_SHA256_MAIN;
     }
     numBlocks = currInputLenBits / SHA256_BLOCK_SIZE_BITS;
@@ -73,13 +84,108 @@ int ErikSha256(unsigned char *inBuff, unsigned long inLenBits, unsigned char *ou
     }
     EndiannessConvertWordSha256(outBuff, SHA256_OUTPUT_BITS);
     free(input); input = NULL;
+    CRYPTO_STAT_END(STAT_OP_SHA256, inLenBits / 8);
+
+    return 0;
+}
+
+// Function to compress one 64B big-endian block into a chaining state
+void CompressBlockSha256(unsigned int hash[8], unsigned char *block) {
+    unsigned int index;
+    unsigned int workingVars[8] = {0};
+    unsigned int messageSchedule[64] = {0};
+    unsigned char wordBlock[SHA256_BLOCK_SIZE_BYTES];
+
+    memcpy(wordBlock, block, SHA256_BLOCK_SIZE_BYTES);
+    EndiannessConvertWordSha256(wordBlock, SHA256_BLOCK_SIZE_BITS);
+    memcpy(workingVars, hash, sizeof(unsigned int)*8);
+    GenMessageScheduleSha256(wordBlock, messageSchedule);
+    CompressFuncSha256(workingVars, messageSchedule);
+    for (index = 0; index < 8; index++) {
+        hash[index] = hash[index] + workingVars[index];
+    }
+}
+
+// Streaming sha256: reset a context to the initial hash values
+void Sha256Init(struct sha256Ctx *ctx) {
+    memcpy(ctx->mid.hash, initHashSha256, sizeof(unsigned int)*8);
+    ctx->mid.numBlocks = 0;
+    ctx->blockLen = 0;
+}
+
+// Streaming sha224: same as sha256 apart from the initial hash values.
+// Sha256Final writes the full 32B state, the digest is its first 28B.
+void Sha224Init(struct sha256Ctx *ctx) {
+    memcpy(ctx->mid.hash, initHashSha224, sizeof(unsigned int)*8);
+    ctx->mid.numBlocks = 0;
+    ctx->blockLen = 0;
+}
+
+// Shared streaming core callback
+static void CompressCoreSha256(void *hash, unsigned char *blocks, unsigned long numBlocks) {
+    unsigned long index;
+
+    for (index = 0; index < numBlocks; index++) {
+        CompressBlockSha256((unsigned int *)hash, blocks+(index*SHA256_BLOCK_SIZE_BYTES));
+    }
+}
+
+static const struct sha2Core coreSha256 = {SHA256_BLOCK_SIZE_BYTES, 8, CompressCoreSha256};
+
+// Streaming sha256: absorb inLen bytes, compressing every completed block
+int Sha256Update(struct sha256Ctx *ctx, unsigned char *input, unsigned long inLen) {
+    if (!ctx || (!input && inLen)) {
+        fprintf(stderr, "ERROR - SHA256: NULL context or input passed to Sha256Update.\n");
+        return ERR_SHA256_STREAM;
+    }
+    Sha2CoreUpdate(&coreSha256, ctx->mid.hash, &ctx->mid.numBlocks, ctx->block, &ctx->blockLen, input, inLen);
+
+    return 0;
+}
+
+// Streaming sha256: pad the buffered tail and write the 32B digest
+int Sha256Final(struct sha256Ctx *ctx, unsigned char *outBuff) {
+    if (!ctx || !outBuff) {
+        fprintf(stderr, "ERROR - SHA256: NULL context or output buffer passed to Sha256Final.\n");
+        return ERR_SHA256_STREAM;
+    }
+    Sha2CoreFinal(&coreSha256, ctx->mid.hash, ctx->mid.numBlocks, ctx->block, ctx->blockLen);
+    memcpy(outBuff, ctx->mid.hash, SHA256_OUTPUT_BYTES);
+    EndiannessConvertWordSha256(outBuff, SHA256_OUTPUT_BITS);
+
+    return 0;
+}
+
+// Function to export the chaining state of a context sitting on a block boundary
+int Sha256ExportMidstate(struct sha256Ctx *ctx, struct sha256Midstate *mid) {
+    if (!ctx || !mid) {
+        fprintf(stderr, "ERROR - SHA256: NULL context or midstate passed to Sha256ExportMidstate.\n");
+        return ERR_SHA256_MIDSTATE;
+    }
+    if (ctx->blockLen) {
+        fprintf(stderr, "ERROR - SHA256: midstate export needs a whole number of blocks, %u bytes are buffered.\n", ctx->blockLen);
+        return ERR_SHA256_MIDSTATE;
+    }
+    memcpy(mid, &ctx->mid, sizeof(struct sha256Midstate));
+
+    return 0;
+}
+
+// Function to resume a context from a previously exported chaining state
+int Sha256ImportMidstate(struct sha256Ctx *ctx, struct sha256Midstate *mid) {
+    if (!ctx || !mid) {
+        fprintf(stderr, "ERROR - SHA256: NULL context or midstate passed to Sha256ImportMidstate.\n");
+        return ERR_SHA256_MIDSTATE;
+    }
+    memcpy(&ctx->mid, mid, sizeof(struct sha256Midstate));
+    ctx->blockLen = 0;
 
     return 0;
 }
 
 // Function for executing sha256 compression function
 void CompressFuncSha256(unsigned int workingVars[8], unsigned int messageSchedule[64]) {
-    unsigned int index, innerIndex;
+    unsigned int index;
     unsigned int T1 = 0, T2 = 0;
     unsigned int *a = &workingVars[0];
     unsigned int *b = &workingVars[1];
@@ -90,6 +196,7 @@ void CompressFuncSha256(unsigned int workingVars[8], unsigned int messageSchedul
     unsigned int *g = &workingVars[6];
     unsigned int *h = &workingVars[7];
 
+    CRYPTO_STAT_ADD(STAT_SHA256_BLOCKS, 1);
     for (index = 0; index < 64; index++) {
         T1 = (*h) + (SHA256_BSIGMA1_FUNC((*e))) + (SHA256_CH_FUNC((*e), (*f), (*g))) 
                 + constantWordsSha256[index] + messageSchedule[index];
@@ -103,13 +210,6 @@ void CompressFuncSha256(unsigned int workingVars[8], unsigned int messageSchedul
         *b = *a;
         *a = T1 + T2;
 
-#if DEBUG
-        fprintf(stderr, "%d: ", index);
-        for (innerIndex = 0; innerIndex < 8; innerIndex++) {
-            fprintf(stderr, "0x%08X ", workingVars[innerIndex]);
-        }
-        fprintf(stderr, "\n");
-#endif
     }
 }
 
@@ -131,22 +231,13 @@ int GenMessageScheduleSha256(unsigned char *inputBlock, unsigned int messageSche
         messageSchedule[index] = ((SHA256_LSIGMA1_FUNC(messageSchedule[index-2])) + messageSchedule[index-7] 
                                     + (SHA256_LSIGMA0_FUNC(messageSchedule[index-15])) + messageSchedule[index-16]);
     }
-#if DEBUG
-    fprintf(stderr, "Message Schedule before starting:\n");
-    for (index = 0; index < 64; index++) {
-        if (!(index % 4) && (index)) {
-        fprintf(stderr, "\n");
-        }
-        fprintf(stderr, "0x%08X\n", messageSchedule[index]);
-    }
-#endif
 
     return 0;
 }
 
 // Function for padding an input to sha256
 int PadInputSha256(unsigned char **inBuff, unsigned long *inLenBitsPtr) {
-    unsigned char *oldInput;
+    unsigned char *oldInput = NULL;
     unsigned char *input = (*inBuff);
     unsigned long newLenBits = 0;
     unsigned long inLenBits = (*inLenBitsPtr);
@@ -161,10 +252,13 @@ int PadInputSha256(unsigned char **inBuff, unsigned long *inLenBitsPtr) {
 
     memcpy(inLenStr, &inLenBits, sizeof(unsigned long));
     if (inLenBits) {
-        oldInput = calloc(inLenBytes, sizeof(unsigned char));
+        if (!(oldInput = calloc(inLenBytes, sizeof(unsigned char)))) {
+            fprintf(stderr, "ERROR - SHA256: unable to allocate memory in PadInputSha256.\n");
+            return ERR_ALLOC;
+        }
         memcpy(oldInput, input, inLenBytes);
-        free(input); input = NULL;
     }
+    free(input); input = NULL;
 
     input = (*inBuff) = calloc(CalcPadBitLenSha256(inLenBits) / 8, sizeof(unsigned char));
     if (!input) {
@@ -193,6 +287,313 @@ int PadInputSha256(unsigned char **inBuff, unsigned long *inLenBitsPtr) {
     return 0;
 }
 
+// FNV-1a parameters used to key the prefix cache
+#define SHA256_FNV_OFFSET         0xcbf29ce484222325UL
+#define SHA256_FNV_PRIME          0x100000001b3UL
+
+// A slot holds either a copy of the prefix or, when keyed, the caller's key for it
+struct sha256PrefixEntry {
+    unsigned long digest;
+    unsigned long lastUsed;
+    unsigned long prefixLen;
+    unsigned char *prefix;
+    unsigned long key;
+    int keyed;
+    struct sha256Midstate mid;
+};
+
+struct sha256PrefixCache {
+    struct sha256PrefixEntry *entries;
+    unsigned int numEntries;
+    unsigned long tick;
+};
+
+// Function to allocate a prefix midstate cache with numEntries slots
+struct sha256PrefixCache *Sha256PrefixCacheCreate(unsigned int numEntries) {
+    struct sha256PrefixCache *cache;
+
+    if (!numEntries || !(cache = calloc(1, sizeof(struct sha256PrefixCache)))) {
+        fprintf(stderr, "ERROR - SHA256: unable to create a prefix cache with %u entries.\n", numEntries);
+        return NULL;
+    }
+    if (!(cache->entries = calloc(numEntries, sizeof(struct sha256PrefixEntry)))) {
+        fprintf(stderr, "ERROR - SHA256: unable to allocate memory in Sha256PrefixCacheCreate.\n");
+        free(cache);
+        return NULL;
+    }
+    cache->numEntries = numEntries;
+
+    return cache;
+}
+
+// Function to free a prefix cache and every prefix it holds
+void Sha256PrefixCacheDestroy(struct sha256PrefixCache *cache) {
+    unsigned int index;
+
+    if (!cache) {
+        return;
+    }
+    for (index = 0; index < cache->numEntries; index++) {
+        free(cache->entries[index].prefix);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+// Function to find the cached midstate for a whole-block prefix, or the slot to evict for it.
+// Keyed lookups match on the caller's key alone and never read the prefix.
+static struct sha256PrefixEntry *LookupPrefixSha256(struct sha256PrefixCache *cache, unsigned char *prefix,
+                                                    unsigned long prefixLen, unsigned long digest, int keyed, int *hit) {
+    unsigned int index;
+    struct sha256PrefixEntry *entry, *victim = &cache->entries[0];
+
+    for (index = 0; index < cache->numEntries; index++) {
+        entry = &cache->entries[index];
+        if (keyed ? (entry->keyed && (entry->key == digest) && (entry->prefixLen == prefixLen))
+                  : (entry->prefix && (entry->digest == digest) && (entry->prefixLen == prefixLen)
+                     && !memcmp(entry->prefix, prefix, prefixLen))) {
+            *hit = 1;
+            return entry;
+        }
+        if (entry->lastUsed < victim->lastUsed) {
+            victim = entry;
+        }
+    }
+    *hit = 0;
+
+    return victim;
+}
+
+// Function to hash prefix || suffix, taking the whole blocks of prefix from the cache when it has them
+static int Sha256PrefixedCore(struct sha256PrefixCache *cache, int keyed, unsigned long prefixKey, unsigned char *prefix,
+                              unsigned long prefixLen, unsigned char *suffix, unsigned long suffixLen, unsigned char *outBuff) {
+    unsigned long blockBytes = prefixLen - (prefixLen % SHA256_BLOCK_SIZE_BYTES);
+    unsigned long digest = SHA256_FNV_OFFSET;
+    unsigned long index;
+    unsigned char *prefixCopy = NULL;
+    struct sha256Ctx ctx;
+    struct sha256PrefixEntry *entry;
+    int hit = 0;
+
+    if ((!prefix && prefixLen) || (!suffix && suffixLen) || !outBuff) {
+        fprintf(stderr, "ERROR - SHA256: invalid prefix, suffix or output buffer provided to a prefixed hash.\n");
+        return ERR_SHA256_MAIN;
+    }
+    Sha256Init(&ctx);
+    if (!cache || !blockBytes) {
+        if (Sha256Update(&ctx, prefix, blockBytes)) {
+            return ERR_SHA256_MAIN;
+        }
+    } else {
+        if (keyed) {
+            digest = prefixKey;
+        } else {
+            for (index = 0; index < blockBytes; index++) {
+                digest = (digest ^ prefix[index]) * SHA256_FNV_PRIME;
+            }
+        }
+        entry = LookupPrefixSha256(cache, prefix, blockBytes, digest, keyed, &hit);
+        if (hit) {
+            Sha256ImportMidstate(&ctx, &entry->mid);
+        } else {
+            if (Sha256Update(&ctx, prefix, blockBytes)) {
+                return ERR_SHA256_MAIN;
+            }
+            if (keyed || (prefixCopy = malloc(blockBytes))) {
+                if (prefixCopy) {
+                    memcpy(prefixCopy, prefix, blockBytes);
+                }
+                free(entry->prefix);
+                entry->prefix = prefixCopy;
+                entry->prefixLen = blockBytes;
+                entry->digest = keyed ? 0 : digest;
+                entry->key = keyed ? prefixKey : 0;
+                entry->keyed = keyed;
+                Sha256ExportMidstate(&ctx, &entry->mid);
+            }
+        }
+        entry->lastUsed = ++cache->tick;
+    }
+    if (((prefixLen > blockBytes) && Sha256Update(&ctx, prefix+blockBytes, prefixLen-blockBytes))
+            || Sha256Update(&ctx, suffix, suffixLen)) {
+        return ERR_SHA256_MAIN;
+    }
+
+    return Sha256Final(&ctx, outBuff);
+}
+
+// Sha256 of prefix || suffix where the midstate after the whole blocks of prefix is cached
+int ErikSha256Prefixed(struct sha256PrefixCache *cache, unsigned char *prefix, unsigned long prefixLen,
+                       unsigned char *suffix, unsigned long suffixLen, unsigned char *outBuff) {
+    return Sha256PrefixedCore(cache, 0, 0, prefix, prefixLen, suffix, suffixLen, outBuff);
+}
+
+/* Sha256 of prefix || suffix where the caller names the prefix with prefixKey.
+ * A hit is found by the key alone, so the whole blocks of prefix are neither
+ * hashed nor compared, only the bytes past the last whole block are read. The
+ * caller must not reuse a key for different prefix bytes while it is cached.
+ */
+int ErikSha256PrefixedKey(struct sha256PrefixCache *cache, unsigned long prefixKey, unsigned char *prefix, unsigned long prefixLen,
+                          unsigned char *suffix, unsigned long suffixLen, unsigned char *outBuff) {
+    if (!cache) {
+        fprintf(stderr, "ERROR - SHA256: keyed prefix hash needs a cache.\n");
+        return ERR_SHA256_MAIN;
+    }
+    return Sha256PrefixedCore(cache, 1, prefixKey, prefix, prefixLen, suffix, suffixLen, outBuff);
+}
+
+// Per message cursor for the multi-buffer path, tail holds the padded last one or two blocks
+struct sha256LaneMsg {
+    unsigned char *input;
+    unsigned long inLen;
+    unsigned long fullBlocks;
+    unsigned long numBlocks;
+    unsigned char tail[2*SHA256_BLOCK_SIZE_BYTES];
+    unsigned char *output;
+};
+
+// Function to compress one block per lane, state is lane-major hash[word][lane]
+static void CompressBlocksLanesSha256(unsigned int hash[8][SHA256_LANES], unsigned char **blocks) {
+    unsigned int w[64][SHA256_LANES], v[8][SHA256_LANES], t1[SHA256_LANES], t2[SHA256_LANES];
+    unsigned int index, lane, word;
+
+    for (index = 0; index < 16; index++) {
+        for (lane = 0; lane < SHA256_LANES; lane++) {
+            w[index][lane] = ((unsigned int)blocks[lane][index*4] << 24) | ((unsigned int)blocks[lane][index*4+1] << 16)
+                           | ((unsigned int)blocks[lane][index*4+2] << 8) | (unsigned int)blocks[lane][index*4+3];
+        }
+    }
+    for (index = 16; index < 64; index++) {
+        for (lane = 0; lane < SHA256_LANES; lane++) {
+            w[index][lane] = SHA256_LSIGMA1_FUNC(w[index-2][lane]) + w[index-7][lane]
+                           + SHA256_LSIGMA0_FUNC(w[index-15][lane]) + w[index-16][lane];
+        }
+    }
+    memcpy(v, hash, sizeof(v));
+    for (index = 0; index < 64; index++) {
+        for (lane = 0; lane < SHA256_LANES; lane++) {
+            t1[lane] = v[7][lane] + SHA256_BSIGMA1_FUNC(v[4][lane]) + SHA256_CH_FUNC(v[4][lane], v[5][lane], v[6][lane])
+                     + constantWordsSha256[index] + w[index][lane];
+            t2[lane] = SHA256_BSIGMA0_FUNC(v[0][lane]) + SHA256_MAJ_FUNC(v[0][lane], v[1][lane], v[2][lane]);
+            v[7][lane] = v[6][lane];
+            v[6][lane] = v[5][lane];
+            v[5][lane] = v[4][lane];
+            v[4][lane] = v[3][lane] + t1[lane];
+            v[3][lane] = v[2][lane];
+            v[2][lane] = v[1][lane];
+            v[1][lane] = v[0][lane];
+            v[0][lane] = t1[lane] + t2[lane];
+        }
+    }
+    for (word = 0; word < 8; word++) {
+        for (lane = 0; lane < SHA256_LANES; lane++) {
+            hash[word][lane] += v[word][lane];
+        }
+    }
+}
+
+// Orders lane messages by length so each group of lanes finishes together
+static int CompareLaneMsgSha256(const void *a, const void *b) {
+    const struct sha256LaneMsg *msgA = a, *msgB = b;
+
+    return (msgA->inLen > msgB->inLen) - (msgA->inLen < msgB->inLen);
+}
+
+// Function to hash count independent messages, SHA256_LANES at a time
+// Lanes whose message is done are fed a dummy block and their state is left alone
+int Sha256MultiBuffer(unsigned char **inputs, unsigned long *inLens, unsigned int count, unsigned char **outputs) {
+    static unsigned char idleBlock[SHA256_BLOCK_SIZE_BYTES];
+    unsigned int hash[8][SHA256_LANES], saved[8][SHA256_LANES];
+    unsigned char *blocks[SHA256_LANES];
+    unsigned long step, maxBlocks, lenBits;
+    unsigned int index, group, lane, word, used, tailLen;
+    struct sha256LaneMsg *msgs, *msg;
+
+    if (!count) {
+        return 0;
+    }
+    if (!inputs || !inLens || !outputs) {
+        fprintf(stderr, "ERROR - SHA256: NULL array passed to Sha256MultiBuffer.\n");
+        return ERR_SHA256_MAIN;
+    }
+    if (!(msgs = calloc(count, sizeof(struct sha256LaneMsg)))) {
+        fprintf(stderr, "ERROR - SHA256: calloc failed to allocate the lane messages.\n");
+        return ERR_ALLOC;
+    }
+    for (index = 0; index < count; index++) {
+        msg = &msgs[index];
+        if ((!inputs[index] && inLens[index]) || !outputs[index]) {
+            fprintf(stderr, "ERROR - SHA256: NULL buffer for message %u passed to Sha256MultiBuffer.\n", index);
+            free(msgs);
+            return ERR_SHA256_MAIN;
+        }
+        msg->input = inputs[index];
+        msg->inLen = inLens[index];
+        msg->output = outputs[index];
+        msg->fullBlocks = msg->inLen / SHA256_BLOCK_SIZE_BYTES;
+        tailLen = msg->inLen % SHA256_BLOCK_SIZE_BYTES;
+        if (tailLen) {
+            memcpy(msg->tail, msg->input + (msg->fullBlocks * SHA256_BLOCK_SIZE_BYTES), tailLen);
+        }
+        msg->tail[tailLen] = 0x80;
+        msg->numBlocks = msg->fullBlocks + ((tailLen >= (SHA256_PAD_ZEROES_VAL / 8)) ? 2 : 1);
+        lenBits = msg->inLen * 8;
+        for (word = 0; word < 8; word++) {
+            msg->tail[((msg->numBlocks - msg->fullBlocks) * SHA256_BLOCK_SIZE_BYTES) - 1 - word] = (lenBits >> (word*8)) & 0xff;
+        }
+        CRYPTO_STAT_ADD(STAT_SHA256_CALLS, 1);
+        CRYPTO_STAT_ADD(STAT_SHA256_BYTES, msg->inLen);
+    }
+    qsort(msgs, count, sizeof(struct sha256LaneMsg), CompareLaneMsgSha256);
+
+    for (group = 0; group < count; group += SHA256_LANES) {
+        used = ((count - group) < SHA256_LANES) ? (count - group) : SHA256_LANES;
+        maxBlocks = 0;
+        for (lane = 0; lane < SHA256_LANES; lane++) {
+            for (word = 0; word < 8; word++) {
+                hash[word][lane] = initHashSha256[word];
+            }
+            if ((lane < used) && (msgs[group+lane].numBlocks > maxBlocks)) {
+                maxBlocks = msgs[group+lane].numBlocks;
+            }
+        }
+        for (step = 0; step < maxBlocks; step++) {
+            for (lane = 0; lane < SHA256_LANES; lane++) {
+                msg = (lane < used) ? &msgs[group+lane] : NULL;
+                if (!msg || (step >= msg->numBlocks)) {
+                    blocks[lane] = idleBlock;
+                } else if (step < msg->fullBlocks) {
+                    blocks[lane] = msg->input + (step * SHA256_BLOCK_SIZE_BYTES);
+                } else {
+                    blocks[lane] = msg->tail + ((step - msg->fullBlocks) * SHA256_BLOCK_SIZE_BYTES);
+                }
+            }
+            memcpy(saved, hash, sizeof(hash));
+            CompressBlocksLanesSha256(hash, blocks);
+            CRYPTO_STAT_ADD(STAT_SHA256_BLOCKS_LANES, SHA256_LANES);
+            // Mask finished lanes back to their final state
+            for (lane = 0; lane < SHA256_LANES; lane++) {
+                if (blocks[lane] == idleBlock) {
+                    for (word = 0; word < 8; word++) {
+                        hash[word][lane] = saved[word][lane];
+                    }
+                }
+            }
+        }
+        for (lane = 0; lane < used; lane++) {
+            for (word = 0; word < 8; word++) {
+                msgs[group+lane].output[word*4] = hash[word][lane] >> 24;
+                msgs[group+lane].output[word*4+1] = hash[word][lane] >> 16;
+                msgs[group+lane].output[word*4+2] = hash[word][lane] >> 8;
+                msgs[group+lane].output[word*4+3] = hash[word][lane];
+            }
+        }
+    }
+    free(msgs); msgs = NULL;
+
+    return 0;
+}
+
 // Function to flip the endianness of a buffer based on 32b words
 int EndiannessConvertWordSha256(unsigned char *buff, unsigned long numBits) {
     unsigned long numWords = (numBits / 32);
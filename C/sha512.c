@@ -0,0 +1,172 @@
+/* Description: C source code for implementation of SHA512, SHA384 and SHA512/256
+ * References:  - FIPS 180-4 Documentation
+ *
+ * Same structure as sha256.c with 64b words, 128B blocks and 80 rounds. The
+ * message schedule is expanded into W+K for a whole block before the rounds
+ * run on local working variables. Streaming goes through the shared SHA2
+ * core in sha2.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Crypto.h"
+
+// Sha512 initial hash values
+static const uint64_t initHashSha512[8] = {0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+                                           0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL};
+
+// Sha384 initial hash values
+static const uint64_t initHashSha384[8] = {0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL, 0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+                                           0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL, 0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL};
+
+// Sha512/256 initial hash values, generated by the FIPS 180-4 SHA-512/t IV function
+static const uint64_t initHashSha512_256[8] = {0x22312194fc2bf72cULL, 0x9f555fa3c84c64c2ULL, 0x2393b86b6f53b151ULL, 0x963877195940eabdULL,
+                                               0x96283ee2a88effe3ULL, 0xbe5e1e2553863992ULL, 0x2b0199fc2c85b8aaULL, 0x0eb72ddc81c52ca2ULL};
+
+// Sha512 constants needed for functionality
+static const uint64_t constantWordsSha512[80] = {0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+                                                 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+                                                 0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+                                                 0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+                                                 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+                                                 0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+                                                 0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+                                                 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+                                                 0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+                                                 0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+                                                 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+                                                 0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+                                                 0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+                                                 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+                                                 0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+                                                 0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+                                                 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+                                                 0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+                                                 0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+                                                 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL};
+
+// Function to read a big-endian 64b word
+static uint64_t LoadBigEndianSha512(unsigned char *buff) {
+    return ((uint64_t)buff[0] << 56) | ((uint64_t)buff[1] << 48) | ((uint64_t)buff[2] << 40) | ((uint64_t)buff[3] << 32)
+            | ((uint64_t)buff[4] << 24) | ((uint64_t)buff[5] << 16) | ((uint64_t)buff[6] << 8) | (uint64_t)buff[7];
+}
+
+// Function to write a big-endian 64b word
+static void StoreBigEndianSha512(unsigned char *buff, uint64_t word) {
+    unsigned int index;
+
+    for (index = 0; index < 8; index++) {
+        buff[index] = (word >> (56 - (index*8))) & 0xff;
+    }
+}
+
+// Function for generating the W+K schedule of one block
+static void GenMessageScheduleSha512(unsigned char *inputBlock, uint64_t scheduleK[SHA512_ROUNDS]) {
+    unsigned int index;
+    uint64_t messageSchedule[SHA512_ROUNDS];
+
+    for (index = 0; index < 16; index++) {
+        messageSchedule[index] = LoadBigEndianSha512(inputBlock+(index*8));
+    }
+    for (; index < SHA512_ROUNDS; index++) {
+        messageSchedule[index] = ((SHA512_LSIGMA1_FUNC(messageSchedule[index-2])) + messageSchedule[index-7]
+                                    + (SHA512_LSIGMA0_FUNC(messageSchedule[index-15])) + messageSchedule[index-16]);
+    }
+    for (index = 0; index < SHA512_ROUNDS; index++) {
+        scheduleK[index] = messageSchedule[index] + constantWordsSha512[index];
+    }
+}
+
+// Function for executing the 80 sha512 rounds on a W+K schedule
+static void CompressFuncSha512(uint64_t hash[8], uint64_t scheduleK[SHA512_ROUNDS]) {
+    unsigned int index;
+    uint64_t T1, T2;
+    uint64_t a = hash[0], b = hash[1], c = hash[2], d = hash[3];
+    uint64_t e = hash[4], f = hash[5], g = hash[6], h = hash[7];
+
+    for (index = 0; index < SHA512_ROUNDS; index++) {
+        T1 = h + (SHA512_BSIGMA1_FUNC(e)) + (SHA512_CH_FUNC(e, f, g)) + scheduleK[index];
+        T2 = (SHA512_BSIGMA0_FUNC(a)) + (SHA512_MAJ_FUNC(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + T1;
+        d = c;
+        c = b;
+        b = a;
+        a = T1 + T2;
+    }
+    hash[0] += a; hash[1] += b; hash[2] += c; hash[3] += d;
+    hash[4] += e; hash[5] += f; hash[6] += g; hash[7] += h;
+}
+
+// Function to compress numBlocks 128B blocks into a chaining state
+void CompressBlocksSha512(uint64_t hash[8], unsigned char *blocks, unsigned long numBlocks) {
+    uint64_t scheduleK[SHA512_ROUNDS];
+    unsigned long index;
+
+    CRYPTO_STAT_ADD(STAT_SHA512_BLOCKS, numBlocks);
+    for (index = 0; index < numBlocks; index++) {
+        GenMessageScheduleSha512(blocks+(index*SHA512_BLOCK_SIZE_BYTES), scheduleK);
+        CompressFuncSha512(hash, scheduleK);
+    }
+}
+
+// Shared streaming core callback
+static void CompressCoreSha512(void *hash, unsigned char *blocks, unsigned long numBlocks) {
+    CompressBlocksSha512((uint64_t *)hash, blocks, numBlocks);
+}
+
+static const struct sha2Core coreSha512 = {SHA512_BLOCK_SIZE_BYTES, 16, CompressCoreSha512};
+
+// Streaming sha512 family: reset a context to the initial hash values of alg
+int Sha512Init(struct sha512Ctx *ctx, enum algorithm alg) {
+    switch (alg) {
+    case SHA512:
+        memcpy(ctx->hash, initHashSha512, sizeof(uint64_t)*8);
+        break;
+    case SHA384:
+        memcpy(ctx->hash, initHashSha384, sizeof(uint64_t)*8);
+        break;
+    case SHA512_256:
+        memcpy(ctx->hash, initHashSha512_256, sizeof(uint64_t)*8);
+        break;
+    default:
+        fprintf(stderr, "ERROR - SHA512: algorithm %d is not part of the SHA512 family.\n", alg);
+        return ERR_SHA2_ALGORITHM;
+    }
+    ctx->numBlocks = 0;
+    ctx->blockLen = 0;
+
+    return 0;
+}
+
+// Streaming sha512 family: absorb inLen bytes, compressing every completed block
+int Sha512Update(struct sha512Ctx *ctx, unsigned char *input, unsigned long inLen) {
+    if (!ctx || (!input && inLen)) {
+        fprintf(stderr, "ERROR - SHA512: NULL context or input passed to Sha512Update.\n");
+        return ERR_SHA512_STREAM;
+    }
+    Sha2CoreUpdate(&coreSha512, ctx->hash, &ctx->numBlocks, ctx->block, &ctx->blockLen, input, inLen);
+
+    return 0;
+}
+
+// Streaming sha512 family: pad the buffered tail and write the full 64B state.
+// Sha384 and Sha512/256 digests are the leading 48B and 32B of it.
+int Sha512Final(struct sha512Ctx *ctx, unsigned char *outBuff) {
+    unsigned int index;
+
+    if (!ctx || !outBuff) {
+        fprintf(stderr, "ERROR - SHA512: NULL context or output buffer passed to Sha512Final.\n");
+        return ERR_SHA512_STREAM;
+    }
+    Sha2CoreFinal(&coreSha512, ctx->hash, ctx->numBlocks, ctx->block, ctx->blockLen);
+    for (index = 0; index < 8; index++) {
+        StoreBigEndianSha512(outBuff+(index*8), ctx->hash[index]);
+    }
+
+    return 0;
+}